@@ -0,0 +1,620 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// End to end benchmark of the proxy: a local TLS websocket feed replays synthetic quotes
+// through websocket_proxy to N client processes, each a WebsocketProxyClient.
+//
+// The feed stamps every quote with its steady clock send time and a sequence number, the clients
+// record feed->client latency and sequence gaps into a shared memory segment the coordinator reads.
+// Each round publishes a fixed number of quotes at a target rate and reports latency percentiles,
+// delivered msg/s and the CPU used by every client and by the proxy. The end to end latency is
+// broken down with the proxy's own histograms: websocket read -> published (proxy), published ->
+// read by the client (queue) and the client callback, see StatsMessage.
+//
+// usage: proxy_benchmark [-c <clients>] [-n <quotes_per_round>] [-R <rate,rate,...>] [-b <quotes_per_frame>]
+//                        [-S <symbols>] [-p <websocket_proxy_path>] [-a "<proxy args>"]
+//   -R rates are quotes per second, 0 publishes as fast as the feed can write. Default to 10000,100000,0.
+//   -a arguments the clients spawn the proxy with, e.g. -a "-r -x -w -1". Ignored if a proxy is already running.
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <websocket_proxy/websocket_proxy_client.h>
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef WEBSOCKET_PROXY_EXE
+#define WEBSOCKET_PROXY_EXE WEBSOCKET_PROXY_PROCESS_NAME
+#endif
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace ssl = asio::ssl;
+using tcp = asio::ip::tcp;
+
+using namespace websocket_proxy;
+
+namespace {
+
+constexpr uint32_t kMaxBenchmarkClients = 64;
+
+enum ClientState : uint32_t {
+    Starting,
+    Ready,
+    Failed,
+};
+
+enum Command : uint32_t {
+    ResetStats,     // clear the client's and the proxy's histograms
+    SnapshotStats,  // copy them to the shared segment
+};
+
+// Written by the client processes, read by the coordinator
+struct BenchmarkClientStats {
+    std::atomic<uint32_t> state;
+    std::atomic<uint64_t> pid;
+    std::atomic<uint64_t> server_pid;
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> gaps;
+    // feed -> client
+    LatencyHistogram latency;
+    // valid once command_ack reached the snapshot command
+    LatencyStats queue_residency;
+    LatencyStats callback;
+    std::atomic<uint64_t> command_ack;
+};
+
+struct BenchmarkShared {
+    std::atomic<uint32_t> stop;
+    std::atomic<uint64_t> command_seq;
+    std::atomic<uint32_t> command;
+    // proxy read latency, requested by client 0
+    LatencyStats proxy_read;
+    BenchmarkClientStats clients[kMaxBenchmarkClients];
+};
+
+// utime + stime of a process in ns, 0 if unknown
+uint64_t processCpuNs(uint64_t pid) {
+#ifdef _WIN32
+    uint64_t cpu = 0;
+    if (HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid)) {
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+            auto ticks = [](const FILETIME& t) { return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+            cpu = (ticks(kernel) + ticks(user)) * 100;
+        }
+        CloseHandle(process);
+    }
+    return cpu;
+#else
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return 0;
+    }
+    // the command name may contain spaces, the fields after it start at the state
+    auto pos = line.rfind(')');
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    std::istringstream iss(line.substr(pos + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 0; i < 13 && iss >> field; ++i) {
+        if (i == 11) {
+            utime = std::stoull(field);
+        }
+        else if (i == 12) {
+            stime = std::stoull(field);
+        }
+    }
+    return (utime + stime) * 1000000000ULL / sysconf(_SC_CLK_TCK);
+#endif
+}
+
+std::filesystem::path selfPath() {
+#ifdef _WIN32
+    wchar_t path[MAX_PATH];
+    GetModuleFileNameW(nullptr, path, MAX_PATH);
+    return std::filesystem::path(path);
+#else
+    return std::filesystem::canonical("/proc/self/exe");
+#endif
+}
+
+uint64_t parseUint(std::string_view text, size_t& pos) {
+    uint64_t value = 0;
+    auto [end, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+    pos = end - text.data();
+    return value;
+}
+
+////////////////////////////// Client process //////////////////////////////
+
+class BenchmarkClient : public WebsocketProxyCallback {
+public:
+    explicit BenchmarkClient(BenchmarkClientStats& stats)
+        : stats_(stats)
+    {}
+
+    void onWebsocketProxyServerDisconnected() override {
+        fprintf(stderr, "proxy disconnected\n");
+    }
+    void onWebsocketOpened(uint64_t) override {}
+    void onWebsocketClosed(uint64_t) override {}
+    void onWebsocketError(uint64_t, const char* err, uint32_t len) override {
+        fprintf(stderr, "websocket error: %.*s\n", static_cast<int>(len), err);
+    }
+
+    void onWebsocketData(uint64_t, const char* data, uint32_t len, uint32_t) override {
+        auto now = get_monotonic_ns();
+        std::string_view frame(data, len);
+        uint64_t received = 0;
+        size_t pos = 0;
+        // quotes end with ..."seq":<n>,"t":<send_ns>}
+        while ((pos = frame.find("\"seq\":", pos)) != std::string_view::npos) {
+            pos += 6;
+            auto seq = parseUint(frame, pos);
+            pos = frame.find("\"t\":", pos);
+            if (pos == std::string_view::npos) {
+                break;
+            }
+            pos += 4;
+            auto sent = parseUint(frame, pos);
+            stats_.latency.record(now > sent ? now - sent : 0);
+            if (last_seq_ && seq > last_seq_ + 1) {
+                stats_.gaps.fetch_add(seq - last_seq_ - 1, std::memory_order_relaxed);
+            }
+            last_seq_ = seq;
+            ++received;
+        }
+        if (received) {
+            stats_.received.fetch_add(received, std::memory_order_relaxed);
+        }
+    }
+
+    void logError(std::function<std::string()>&& fn) override {
+        fprintf(stderr, "%s\n", fn().c_str());
+    }
+
+private:
+    BenchmarkClientStats& stats_;
+    uint64_t last_seq_ = 0;
+};
+
+// proxy_benchmark --client <index> <shm_name> <url> <symbols> <proxy_path> [proxy args...]
+int runClient(int argc, char* argv[]) {
+    if (argc < 7) {
+        fprintf(stderr, "invalid client arguments\n");
+        return 1;
+    }
+    auto index = static_cast<uint32_t>(std::stoul(argv[2]));
+    SharedMemory shm(argv[3], sizeof(BenchmarkShared));
+    auto shared = static_cast<BenchmarkShared*>(shm.data());
+    auto& stats = shared->clients[index];
+    stats.pid.store(getCurrentProcessId(), std::memory_order_relaxed);
+
+    std::string url = argv[4];
+    auto symbols = static_cast<uint32_t>(std::stoul(argv[5]));
+    std::string proxy_path = argv[6];
+    std::string proxy_args;
+    for (int i = 7; i < argc; ++i) {
+        proxy_args += (proxy_args.empty() ? "" : " ") + std::string(argv[i]);
+    }
+
+    try {
+        BenchmarkClient callback(stats);
+        WebsocketProxyClient client(&callback, "bench_" + std::to_string(index), std::move(proxy_path), std::move(proxy_args));
+        auto [id, new_connection] = client.openWebSocket(url, "");
+        if (!id) {
+            stats.state.store(ClientState::Failed, std::memory_order_release);
+            return 1;
+        }
+        for (uint32_t i = 0; i < symbols; ++i) {
+            auto symbol = "SYM" + std::to_string(i);
+            auto request = "{\"action\":\"subscribe\",\"quotes\":[\"" + symbol + "\"]}";
+            bool existing = false;
+            if (!client.subscribe(id, symbol, request.c_str(), static_cast<uint32_t>(request.size()), SubscriptionType::Quotes, existing)) {
+                stats.state.store(ClientState::Failed, std::memory_order_release);
+                return 1;
+            }
+        }
+        stats.server_pid.store(client.serverId(), std::memory_order_relaxed);
+        stats.state.store(ClientState::Ready, std::memory_order_release);
+
+        uint64_t command_ack = 0;
+        while (!shared->stop.load(std::memory_order_acquire)) {
+            auto seq = shared->command_seq.load(std::memory_order_acquire);
+            if (seq == command_ack) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            StatsMessage proxy_stats{};
+            if (shared->command.load(std::memory_order_relaxed) == Command::ResetStats) {
+                client.resetLatencyStats();
+                if (index == 0) {
+                    client.requestStats(proxy_stats, true);
+                }
+            }
+            else {
+                stats.queue_residency = client.queueResidency().stats();
+                stats.callback = client.callbackDuration().stats();
+                if (index == 0 && client.requestStats(proxy_stats, true)) {
+                    shared->proxy_read = proxy_stats.read;
+                }
+            }
+            command_ack = seq;
+            stats.command_ack.store(seq, std::memory_order_release);
+        }
+        client.closeWebSocket(id);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "client %u: %s\n", index, e.what());
+        stats.state.store(ClientState::Failed, std::memory_order_release);
+        return 1;
+    }
+    return 0;
+}
+
+////////////////////////////// Feed server //////////////////////////////
+
+// Self signed certificate for the local feed, the proxy doesn't verify its peers
+void useSelfSignedCertificate(ssl::context& ctx) {
+    auto pkey = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256");
+    auto cert = X509_new();
+    if (!pkey || !cert) {
+        throw std::runtime_error("Failed to generate the feed certificate");
+    }
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, pkey);
+    auto name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, pkey, EVP_sha256());
+    auto ok = SSL_CTX_use_certificate(ctx.native_handle(), cert) == 1 && SSL_CTX_use_PrivateKey(ctx.native_handle(), pkey) == 1;
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    if (!ok) {
+        throw std::runtime_error("Failed to load the feed certificate");
+    }
+}
+
+// Alpaca style quote feed on 127.0.0.1. The proxy shares one upstream websocket between
+// all clients, so the feed serves a single connection.
+class FeedServer {
+public:
+    FeedServer(uint32_t symbols, uint32_t batch)
+        : acceptor_(ioc_, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0))
+        , symbols_(symbols)
+        , batch_(batch)
+    {
+        useSelfSignedCertificate(ctx_);
+    }
+
+    uint16_t port() const { return acceptor_.local_endpoint().port(); }
+
+    // Blocks until the proxy connects
+    void accept() {
+        tcp::socket socket(ioc_);
+        acceptor_.accept(socket);
+        socket.set_option(tcp::no_delay(true));
+        ws_ = std::make_unique<websocket::stream<ssl::stream<tcp::socket>>>(std::move(socket), ctx_);
+        ws_->next_layer().handshake(ssl::stream_base::server);
+        ws_->accept();
+        ws_->text(true);
+        // Subscribe requests from the proxy are never read, the socket buffers hold them.
+        write(R"([{"T":"success","msg":"connected"}])");
+    }
+
+    // Publishes count quotes at rate quotes/s, 0 for as fast as possible. Returns the elapsed ns.
+    uint64_t publish(uint64_t count, uint64_t rate) {
+        std::string frame;
+        frame.reserve(batch_ * 160 + 2);
+        char quote[160];
+        auto frame_interval = rate ? 1000000000.0 * batch_ / rate : 0.0;
+        auto start = get_monotonic_ns();
+        uint64_t frames = 0;
+        for (uint64_t sent = 0; sent < count; ++frames) {
+            if (rate) {
+                auto due = start + static_cast<uint64_t>(frames * frame_interval);
+                while (get_monotonic_ns() < due) {
+                    cpu_relax();
+                }
+            }
+            frame = "[";
+            auto now = get_monotonic_ns();
+            for (uint32_t i = 0; i < batch_ && sent < count; ++i, ++sent) {
+                auto seq = ++seq_;
+                auto n = snprintf(quote, sizeof(quote),
+                    R"(%s{"T":"q","S":"SYM%u","bx":"V","bp":187.45,"bs":3,"ax":"V","ap":187.47,"as":2,"c":["R"],"z":"C","seq":%llu,"t":%llu})",
+                    i ? "," : "", static_cast<uint32_t>(seq % symbols_), static_cast<unsigned long long>(seq), static_cast<unsigned long long>(now));
+                frame.append(quote, n);
+            }
+            frame += ']';
+            write(frame);
+        }
+        return get_monotonic_ns() - start;
+    }
+
+    void close() {
+        if (ws_) {
+            beast::error_code ec;
+            ws_->next_layer().next_layer().close(ec);
+        }
+    }
+
+private:
+    void write(std::string_view data) {
+        ws_->write(asio::buffer(data.data(), data.size()));
+    }
+
+    asio::io_context ioc_;
+    ssl::context ctx_{ ssl::context::tlsv12_server };
+    tcp::acceptor acceptor_;
+    std::unique_ptr<websocket::stream<ssl::stream<tcp::socket>>> ws_;
+    uint32_t symbols_;
+    uint32_t batch_;
+    uint64_t seq_ = 0;
+};
+
+////////////////////////////// Coordinator //////////////////////////////
+
+struct Options {
+    uint32_t clients = 1;
+    uint64_t count = 1000000;
+    std::vector<uint64_t> rates{ 10000, 100000, 0 };
+    uint32_t batch = 1;
+    uint32_t symbols = 16;
+    std::string proxy_path = WEBSOCKET_PROXY_EXE;
+    std::string proxy_args;
+};
+
+bool waitForClient(BenchmarkClientStats& stats, uint32_t index) {
+    auto start = get_timestamp();
+    while ((get_timestamp() - start) < 60000) {
+        auto state = stats.state.load(std::memory_order_acquire);
+        if (state == ClientState::Ready) {
+            return true;
+        }
+        if (state == ClientState::Failed) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    fprintf(stderr, "client %u failed to start\n", index);
+    return false;
+}
+
+// Waits until every client received count quotes, or nothing arrived for 2 seconds
+void waitForDelivery(BenchmarkShared& shared, uint32_t clients, uint64_t count) {
+    uint64_t last_total = 0;
+    auto last_progress = get_timestamp();
+    while ((get_timestamp() - last_progress) < 2000) {
+        uint64_t total = 0;
+        bool done = true;
+        for (uint32_t i = 0; i < clients; ++i) {
+            auto received = shared.clients[i].received.load(std::memory_order_relaxed);
+            total += received;
+            done &= received >= count;
+        }
+        if (done) {
+            return;
+        }
+        if (total != last_total) {
+            last_total = total;
+            last_progress = get_timestamp();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Runs a command in every client and waits for all of them
+bool runCommand(BenchmarkShared& shared, uint32_t clients, Command command) {
+    shared.command.store(command, std::memory_order_relaxed);
+    auto seq = shared.command_seq.fetch_add(1, std::memory_order_acq_rel) + 1;
+    auto start = get_timestamp();
+    for (uint32_t i = 0; i < clients; ++i) {
+        while (shared.clients[i].command_ack.load(std::memory_order_acquire) != seq) {
+            if ((get_timestamp() - start) > 10000) {
+                fprintf(stderr, "client %u didn't answer\n", i);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    return true;
+}
+
+void printLatency(const char* name, const LatencyStats& latency) {
+    printf("  %-8s p50=%8.1fus p90=%8.1fus p99=%8.1fus p99.9=%8.1fus max=%8.1fus",
+        name, latency.p50 / 1000.0, latency.p90 / 1000.0, latency.p99 / 1000.0, latency.p999 / 1000.0, latency.max / 1000.0);
+}
+
+int runCoordinator(const Options& options) {
+    auto shm_name = "websocket_proxy_benchmark_" + std::to_string(getCurrentProcessId());
+    SharedMemory shm(shm_name, sizeof(BenchmarkShared));
+    auto shared = new (shm.data()) BenchmarkShared();
+
+    FeedServer feed(options.symbols, options.batch);
+    auto url = "wss://127.0.0.1:" + std::to_string(feed.port()) + "/feed";
+    auto connected = std::async(std::launch::async, [&feed]() { feed.accept(); });
+
+    printf("feed=%s clients=%u quotes/round=%llu quotes/frame=%u symbols=%u proxy=%s %s\n",
+        url.c_str(), options.clients, static_cast<unsigned long long>(options.count), options.batch, options.symbols,
+        options.proxy_path.c_str(), options.proxy_args.c_str());
+
+    // Start the clients one at a time so only the first one spawns the proxy
+    auto self = selfPath();
+    for (uint32_t i = 0; i < options.clients; ++i) {
+        std::string args = "--client " + std::to_string(i) + " " + shm_name + " " + url + " "
+            + std::to_string(options.symbols) + " " + options.proxy_path + " " + options.proxy_args;
+        std::string err;
+        if (!spawnProcess(self, args, err)) {
+            fprintf(stderr, "Failed to spawn client %u. %s\n", i, err.c_str());
+            shared->stop.store(1, std::memory_order_release);
+            return 1;
+        }
+        if (!waitForClient(shared->clients[i], i)) {
+            shared->stop.store(1, std::memory_order_release);
+            return 1;
+        }
+    }
+    if (connected.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+        fprintf(stderr, "proxy didn't connect to the feed\n");
+        shared->stop.store(1, std::memory_order_release);
+        return 1;
+    }
+    connected.get();
+
+    auto server_pid = shared->clients[0].server_pid.load(std::memory_order_relaxed);
+    printf("proxy pid=%llu\n", static_cast<unsigned long long>(server_pid));
+
+    uint64_t max_sustained = 0;
+    for (auto rate : options.rates) {
+        std::vector<uint64_t> client_cpu(options.clients);
+        for (uint32_t i = 0; i < options.clients; ++i) {
+            auto& stats = shared->clients[i];
+            stats.received.store(0, std::memory_order_relaxed);
+            stats.gaps.store(0, std::memory_order_relaxed);
+            stats.latency.reset();
+            client_cpu[i] = processCpuNs(stats.pid.load(std::memory_order_relaxed));
+        }
+        runCommand(*shared, options.clients, Command::ResetStats);
+        auto proxy_cpu = processCpuNs(server_pid);
+
+        auto start = get_monotonic_ns();
+        auto publish_ns = feed.publish(options.count, rate);
+        waitForDelivery(*shared, options.clients, options.count);
+        auto elapsed_ns = get_monotonic_ns() - start;
+        auto snapshot = runCommand(*shared, options.clients, Command::SnapshotStats);
+
+        auto feed_rate = options.count * 1e9 / publish_ns;
+        printf("\nrate=%s sent=%llu in %.3fs (%.0f msg/s)\n", rate ? std::to_string(rate).c_str() : "max",
+            static_cast<unsigned long long>(options.count), publish_ns / 1e9, feed_rate);
+
+        LatencyHistogram all;
+        LatencyStats queue_residency{};
+        LatencyStats callback{};
+        bool lossless = true;
+        for (uint32_t i = 0; i < options.clients; ++i) {
+            auto& stats = shared->clients[i];
+            auto received = stats.received.load(std::memory_order_relaxed);
+            auto gaps = stats.gaps.load(std::memory_order_relaxed);
+            auto cpu = processCpuNs(stats.pid.load(std::memory_order_relaxed)) - client_cpu[i];
+            all.merge(stats.latency);
+            queue_residency.worst(stats.queue_residency);
+            callback.worst(stats.callback);
+            lossless &= received >= options.count && !gaps;
+            auto name = "client" + std::to_string(i);
+            printLatency(name.c_str(), stats.latency.stats());
+            printf(" received=%llu gaps=%llu cpu=%.1f%% %.0fns/msg\n", static_cast<unsigned long long>(received),
+                static_cast<unsigned long long>(gaps), cpu * 100.0 / elapsed_ns, received ? static_cast<double>(cpu) / received : 0.0);
+        }
+        printLatency("all", all.stats());
+        printf(" feed->client\n");
+        if (snapshot) {
+            printLatency("proxy", shared->proxy_read);
+            printf(" websocket read->published\n");
+            printLatency("queue", queue_residency);
+            printf(" published->client read, worst client\n");
+            printLatency("callback", callback);
+            printf(" onWebsocketData, worst client\n");
+        }
+        auto cpu = processCpuNs(server_pid) - proxy_cpu;
+        printf("  proxy    cpu=%.1f%% %.0fns/msg delivered=%.0f msg/s per client\n", cpu * 100.0 / elapsed_ns,
+            static_cast<double>(cpu) / options.count, all.count() / (elapsed_ns / 1e9) / options.clients);
+
+        // sustained: everything delivered while keeping up with the target rate
+        if (lossless && (!rate || feed_rate >= rate * 0.95)) {
+            max_sustained = std::max(max_sustained, static_cast<uint64_t>(feed_rate));
+        }
+    }
+    printf("\nmax sustained=%llu msg/s\n", static_cast<unsigned long long>(max_sustained));
+
+    shared->stop.store(1, std::memory_order_release);
+    // give the clients time to close their websocket before the feed goes away
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    feed.close();
+    return 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        return runClient(argc, argv);
+    }
+
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            options.clients = std::min(static_cast<uint32_t>(std::stoul(argv[++i])), kMaxBenchmarkClients);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            options.count = std::stoull(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            options.rates.clear();
+            std::istringstream iss(argv[++i]);
+            for (std::string rate; std::getline(iss, rate, ',');) {
+                options.rates.emplace_back(std::stoull(rate));
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            options.batch = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            options.symbols = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            options.proxy_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            options.proxy_args = argv[++i];
+        }
+    }
+
+    try {
+        return runCoordinator(options);
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,136 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// Measures the cost of reserving WsData messages in a SlickQueue when the whole
+// message is zeroed versus only the Message and WsData headers.
+//
+// usage: reserve_benchmark [payload_len=200] [messages=10000000] [queue_size=1<<24] [consumer=1]
+
+#include <websocket_proxy/types.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace websocket_proxy;
+
+namespace {
+
+struct Result {
+    double seconds;
+    uint64_t consumed;
+};
+
+// the pre builder behaviour, the payload is zeroed and then overwritten
+void publishFullMemset(SHM_QUEUE_T& queue, const char* payload, uint32_t len) {
+    auto size = get_message_size<WsData>(len);
+    auto index = queue.reserve(size);
+    auto ptr = queue[index];
+    memset(ptr, 0, size);
+    auto msg = reinterpret_cast<Message*>(ptr);
+    msg->pid = 1;
+    msg->type = Message::Type::WsData;
+    auto d = reinterpret_cast<WsData*>(msg->data);
+    d->id = 1;
+    d->len = len;
+    memcpy(d->data, payload, len);
+    queue.publish(index, size);
+}
+
+void publishHeaderOnly(SHM_QUEUE_T& queue, const char* payload, uint32_t len) {
+    auto [msg, d, index, size] = reserveMessageSlot<WsData>(queue, 1, Message::Type::WsData, len);
+    d->id = 1;
+    d->len = len;
+    memcpy(d->data, payload, len);
+    queue.publish(index, size);
+}
+
+template<typename Publish>
+Result run(Publish publish, const std::vector<char>& payload, uint64_t count, uint32_t queue_size, bool consumer) {
+    SHM_QUEUE_T queue(queue_size);
+    std::atomic_bool done{false};
+    std::atomic<uint64_t> consumed{0};
+    std::thread reader;
+    if (consumer) {
+        reader = std::thread([&]() {
+            auto read_index = queue.initial_reading_index();
+            uint64_t n = 0;
+            while (true) {
+                auto [data, size] = queue.read(read_index);
+                if (data) {
+                    ++n;
+                    continue;
+                }
+                if (done.load(std::memory_order_acquire)) {
+                    break;
+                }
+            }
+            consumed.store(n, std::memory_order_release);
+        });
+    }
+
+    auto len = static_cast<uint32_t>(payload.size());
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; ++i) {
+        publish(queue, payload.data(), len);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    done.store(true, std::memory_order_release);
+    if (reader.joinable()) {
+        reader.join();
+    }
+    return Result{ elapsed, consumed.load(std::memory_order_acquire) };
+}
+
+void report(const char* name, const Result& r, uint64_t count, uint32_t len) {
+    auto rate = count / r.seconds;
+    auto bytes = static_cast<double>(get_message_size<WsData>(len)) * count;
+    printf("%-14s %10.3f s %12.0f msgs/s %10.1f MB/s", name, r.seconds, rate, bytes / r.seconds / (1024.0 * 1024.0));
+    if (r.consumed) {
+        printf("  consumed=%llu", static_cast<unsigned long long>(r.consumed));
+    }
+    printf("\n");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t payload_len = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 200;
+    uint64_t count = argc > 2 ? std::stoull(argv[2]) : 10000000ULL;
+    uint32_t queue_size = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : (1u << 24);
+    bool consumer = argc > 4 ? std::atoi(argv[4]) != 0 : true;
+
+    // a quote-like frame, the content doesn't matter for the copy cost
+    std::vector<char> payload(payload_len, 'q');
+
+    printf("payload=%u bytes, message=%u bytes, messages=%llu, queue_size=%u, consumer=%s\n",
+        payload_len, get_message_size<WsData>(payload_len), static_cast<unsigned long long>(count), queue_size, consumer ? "on" : "off");
+
+    for (int round = 0; round < 3; ++round) {
+        report("full memset", run(publishFullMemset, payload, count, queue_size, consumer), count, payload_len);
+        report("header only", run(publishHeaderOnly, payload, count, queue_size, consumer), count, payload_len);
+    }
+    return 0;
+}
@@ -4,7 +4,6 @@
 #include <nlohmann/json.hpp>
 #include <string>
 #include <iostream>
-#include <sstream>
 #include <atomic>
 
 namespace alpaca_websocket {
@@ -17,7 +16,6 @@ class AlpacaWebSocketClient : public WebSocketProxyClient, public websocket_prox
     std::string url_;
     std::string api_key_;
     std::string api_secret_;
-    std::stringstream ss_;
     std::atomic_bool authenticated_;
 
     enum RequestStatus : uint8_t
@@ -32,7 +30,10 @@ class AlpacaWebSocketClient : public WebSocketProxyClient, public websocket_prox
 public:
     AlpacaWebSocketClient(std::string &&proxy_exe_path)
         : WebSocketProxyClient(this, "AlpacaWebSocketClient", std::move(proxy_exe_path))
-    {}
+    {
+        // frames are decoded in place into onQuote, onTrade, onBar and onStatus
+        decodeMarketData(true);
+    }
 
     ~AlpacaWebSocketClient() override
     {
@@ -47,25 +48,18 @@ public:
 
         request_status_.store(RequestStatus::WaitingForResult, std::memory_order_relaxed);
         auto [ws_id, is_new_connection] = openWebSocket(url_, api_key_);
+        request_status_.store(RequestStatus::None, std::memory_order_relaxed);
         if (!ws_id)
         {
             return false;
         }
-
+        ws_id_ = ws_id;
         if (!is_new_connection)
         {
-            ws_id_ = ws_id;
-            request_status_.store(RequestStatus::None, std::memory_order_relaxed);
             std::cout << url_ << " key=" << api_key_ << " already connected" << std::endl;
-            return true;
-        }
-
-        RequestStatus status;
-        while((status = request_status_.load(std::memory_order_relaxed)) == RequestStatus::WaitingForResult)
-        {
-            std::this_thread::yield();
         }
-        return status == RequestStatus::Completed;
+        // the proxy authenticates the shared connection once, later clients get the cached reply
+        return authenticate();
     }
 
     void close()
@@ -125,94 +119,56 @@ public:
 
     void onWebsocketData(uint64_t id, const char* data, uint32_t len, uint32_t remaining) override
     {
-        if (data && len)
-        {
-            ss_ << std::string(data, len);
-        }
+        // only frames that aren't JSON arrays
+        std::cout << "Data: " << std::string(data, len) << std::endl;
+    }
 
-        if (remaining == 0) 
-        { // message complete
-            try
+    void onQuote(const websocket_proxy::QuoteMessage& quote) override
+    {
+        std::cout << "Quote: " << quote.symbol << " bid=" << quote.bid_price << 'x' << quote.bid_size
+            << " ask=" << quote.ask_price << 'x' << quote.ask_size << " t=" << quote.timestamp << std::endl;
+    }
+
+    void onTrade(const websocket_proxy::TradeMessage& trade) override
+    {
+        std::cout << "Trade: " << trade.symbol << ' ' << trade.size << '@' << trade.price << " t=" << trade.timestamp << std::endl;
+    }
+
+    void onStatus(uint64_t id, const char* data, uint32_t len) override
+    {
+        // control messages are rare, parse them fully
+        try
+        {
+            nlohmann::json obj = nlohmann::json::parse(data, data + len);
+            const auto& type = obj["T"];
+            if (type == "error")
             {
-                nlohmann::json j = nlohmann::json::parse(ss_.str());
-                if (j.is_array())
+                std::cout << "On Ws error" << obj["msg"] << '('<< obj["code"] << ')' << std::endl;
+                if (request_status_.load(std::memory_order_relaxed) == RequestStatus::WaitingForResult)
                 {
-                    for (auto& item : j.items()) 
-                    {
-                        auto &obj = item.value();
-                        if (!obj.is_object())
-                        {
-                            assert(false);
-                            continue;
-                        }
-
-                        if (obj.contains("T"))
-                        {
-                            const auto& type = obj["T"];
-                            if (type == "error")
-                            {
-                                std::cout << "On Ws error" << obj["msg"] << '('<< obj["code"] << ')' << std::endl;
-                                if (request_status_.load(std::memory_order_relaxed) == RequestStatus::WaitingForResult)
-                                {
-                                    request_status_.store(RequestStatus::Failed, std::memory_order_relaxed);
-                                }
-                                closeWebSocket(id);
-                                break;
-                            }
-
-                            if (type == "success")
-                            {
-                                auto &msg = obj["msg"].get_ref<const std::string&>();
-                                if (msg == "connected")
-                                {
-                                    authenticate();
-                                }
-                                else if (msg == "authenticated")
-                                {
-                                    std::cout << "Authenticated" << std::endl;
-                                    if (request_status_.load(std::memory_order_relaxed) == RequestStatus::WaitingForResult)
-                                    {
-                                        request_status_.store(RequestStatus::Completed, std::memory_order_relaxed);
-                                    }
-                                }
-                                else
-                                {
-                                    std::cout << ss_.str() << std::endl;
-                                }
-                            }
-                            else if (type == "subscription")
-                            {
-                                // subscription
-                                std::cout << "subscription: " << ss_.str() << std::endl;
-
-                                // TODO: when multiple clients subscribe at the same time, it's better to check the symbol
-                                if (request_status_.load(std::memory_order_relaxed) == RequestStatus::WaitingForResult)
-                                {
-                                    request_status_.store(RequestStatus::Failed, std::memory_order_relaxed);
-                                }
-                            }
-                            else if (type == "t")
-                            {
-                                // trade
-                                std::cout << "Trade: " << ss_.str() << std::endl;
-                            }
-                            else if (type == "q")
-                            {
-                                // quote
-                                std::cout << "Quote: " << ss_.str() << std::endl;
-                            }
-                        }
-                    }
+                    request_status_.store(RequestStatus::Failed, std::memory_order_relaxed);
                 }
+                closeWebSocket(id);
             }
-            catch(const std::exception& e)
+            else if (type == "success")
             {
-                // When mutile instances connected to the proxy, a new instance 
-                // might reading a partial message from the queue. Drop the invalid message
+                // connected and authenticated are handled by the proxy, see authenticate()
+                std::cout << obj.dump() << std::endl;
             }
+            else if (type == "subscription")
+            {
+                std::cout << "subscription: " << obj.dump() << std::endl;
 
-            // reset message buffer
-            ss_.str("");
+                // TODO: when multiple clients subscribe at the same time, it's better to check the symbol
+                if (request_status_.load(std::memory_order_relaxed) == RequestStatus::WaitingForResult)
+                {
+                    request_status_.store(RequestStatus::Failed, std::memory_order_relaxed);
+                }
+            }
+        }
+        catch(const std::exception& e)
+        {
+            // drop the invalid message
         }
     }
 
@@ -235,7 +191,7 @@ public:
     }
 
 private:
-    void authenticate()
+    bool authenticate()
     {
         nlohmann::json j;
         j["action"] = "auth";
@@ -243,7 +199,10 @@ private:
         j["secret"] = api_secret_;
         std::cout << "Authenticating..." << std::endl;
         auto str = j.dump();
-        send(ws_id_, str.c_str(), (uint32_t)str.size());
+        std::string response;
+        bool authenticated = WebSocketProxyClient::authenticate(ws_id_, str.c_str(), (uint32_t)str.size(), "\"authenticated\"", "\"T\":\"error\"", &response);
+        std::cout << (authenticated ? "Authenticated " : "Authentication failed ") << response << std::endl;
+        return authenticated;
     }
 };
 
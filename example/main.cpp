@@ -52,9 +52,9 @@ int main(int argc, char* argv[])
     }
 
 #ifdef DEBUG
-    std::string proxy_exe("./build/bin/Debug/websocket_proxy.exe");
+    std::string proxy_exe("./build/bin/Debug/" WEBSOCKET_PROXY_PROCESS_NAME);
 #else
-    std::string proxy_exe("./build/bin/Release/websocket_proxy.exe");
+    std::string proxy_exe("./build/bin/Release/" WEBSOCKET_PROXY_PROCESS_NAME);
 #endif
 
     signal(SIGINT, signalHandler);
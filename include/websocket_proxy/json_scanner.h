@@ -0,0 +1,282 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WEBSOCKET_PROXY_SSE2
+#endif
+
+// Minimal in-place JSON scanning used on the data path.
+// It only locates structure (object boundaries, string fields), no DOM is built and nothing is allocated.
+namespace websocket_proxy::json {
+
+namespace detail {
+
+// A block of input bytes compared against single characters to produce bit masks.
+#if defined(__AVX2__)
+struct Block {
+    static constexpr size_t size = 32;
+    __m256i v;
+    explicit Block(const char* p) : v(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) {}
+    uint32_t eq(char c) const noexcept {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+    }
+};
+#elif defined(WEBSOCKET_PROXY_SSE2)
+struct Block {
+    static constexpr size_t size = 16;
+    __m128i v;
+    explicit Block(const char* p) : v(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+    uint32_t eq(char c) const noexcept {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+    }
+};
+#else
+struct Block {
+    static constexpr size_t size = 16;
+    const char* p;
+    explicit Block(const char* p) : p(p) {}
+    uint32_t eq(char c) const noexcept {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < size; ++i) {
+            mask |= static_cast<uint32_t>(p[i] == c) << i;
+        }
+        return mask;
+    }
+};
+#endif
+
+inline const char* skipWhitespace(const char* p, const char* end) noexcept {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        ++p;
+    }
+    return p;
+}
+
+// the end of the text before trailing whitespace
+inline const char* trimWhitespace(const char* begin, const char* end) noexcept {
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) {
+        --end;
+    }
+    return end;
+}
+
+}
+
+// Finds the first occurrence of needle in [begin, end). Candidates are located by
+// comparing the first and the last needle characters a block at a time.
+inline const char* find(const char* begin, const char* end, std::string_view needle) noexcept {
+    auto n = needle.size();
+    if (n == 0) {
+        return begin;
+    }
+    if (static_cast<size_t>(end - begin) < n) {
+        return nullptr;
+    }
+
+    const char* p = begin;
+    if (n > 1) {
+        while (p + n - 1 + detail::Block::size <= end) {
+            uint32_t mask = detail::Block(p).eq(needle.front()) & detail::Block(p + n - 1).eq(needle.back());
+            while (mask) {
+                auto i = std::countr_zero(mask);
+                if (memcmp(p + i + 1, needle.data() + 1, n - 2) == 0) {
+                    return p + i;
+                }
+                mask &= mask - 1;
+            }
+            p += detail::Block::size;
+        }
+    }
+
+    for (auto last = end - n; p <= last; ++p) {
+        if (*p == needle.front() && memcmp(p + 1, needle.data() + 1, n - 1) == 0) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// Returns the string value of the first `quoted_key: "value"` pair in [begin, end),
+// e.g. findStringField(obj, end, "\"S\"") returns the symbol of an Alpaca message.
+// Escaped characters in the value are not decoded.
+inline std::string_view findStringField(const char* begin, const char* end, std::string_view quoted_key, const char** next = nullptr) noexcept {
+    const char* p = begin;
+    while ((p = find(p, end, quoted_key)) != nullptr) {
+        p += quoted_key.size();
+        auto q = detail::skipWhitespace(p, end);
+        if (q >= end || *q != ':') {
+            // the key matched a string value
+            continue;
+        }
+        q = detail::skipWhitespace(q + 1, end);
+        if (q >= end || *q != '"') {
+            continue;
+        }
+        auto value = ++q;
+        auto close = static_cast<const char*>(memchr(value, '"', end - value));
+        if (!close) {
+            break;
+        }
+        if (next) {
+            *next = close + 1;
+        }
+        return std::string_view(value, close - value);
+    }
+    if (next) {
+        *next = end;
+    }
+    return {};
+}
+
+// Returns the raw token of the first `quoted_key: number` pair in [begin, end), e.g. 150.25 or 1e-3
+inline std::string_view findNumberField(const char* begin, const char* end, std::string_view quoted_key) noexcept {
+    const char* p = begin;
+    while ((p = find(p, end, quoted_key)) != nullptr) {
+        p += quoted_key.size();
+        auto q = detail::skipWhitespace(p, end);
+        if (q >= end || *q != ':') {
+            continue;
+        }
+        auto value = detail::skipWhitespace(q + 1, end);
+        q = value;
+        while (q < end && ((*q >= '0' && *q <= '9') || *q == '-' || *q == '+' || *q == '.' || *q == 'e' || *q == 'E')) {
+            ++q;
+        }
+        if (q != value) {
+            return std::string_view(value, q - value);
+        }
+    }
+    return {};
+}
+
+// Calls fn(std::string_view) for every "S" (symbol) field in the frame. Returns true if any was found.
+template<typename Fn>
+inline bool forEachSymbol(const char* data, size_t len, Fn&& fn) {
+    bool found = false;
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        auto symbol = findStringField(p, end, "\"S\"", &p);
+        if (symbol.data() == nullptr) {
+            break;
+        }
+        found = true;
+        fn(symbol);
+    }
+    return found;
+}
+
+// Calls fn(const char* object, size_t len) for every object of a top-level JSON array,
+// e.g. [{"T":"q",...},{"T":"t",...}]. Quotes, escapes and braces are located a block at a time
+// and blocks without structural characters are skipped entirely.
+// Returns false if the frame is not an array or is truncated.
+template<typename Fn>
+inline bool forEachObject(const char* data, size_t len, Fn&& fn) {
+    const char* end = data + len;
+    const char* p = detail::skipWhitespace(data, end);
+    if (p >= end || *p != '[') {
+        return false;
+    }
+    ++p;
+
+    uint32_t depth = 0;
+    bool in_string = false;
+    bool escaped = false;   // the first character of the next block is escaped
+    const char* object = nullptr;
+
+    auto on_char = [&](const char* c) {
+        if (in_string) {
+            if (*c == '\\') {
+                return true;    // skip the escaped character
+            }
+            if (*c == '"') {
+                in_string = false;
+            }
+        }
+        else if (*c == '"') {
+            in_string = true;
+        }
+        else if (*c == '{') {
+            if (depth++ == 0) {
+                object = c;
+            }
+        }
+        else if (*c == '}' && depth && --depth == 0) {
+            fn(object, static_cast<size_t>(c + 1 - object));
+        }
+        return false;
+    };
+
+    while (p + detail::Block::size <= end) {
+        detail::Block block(p);
+        uint32_t strings = block.eq('"') | block.eq('\\');
+        uint32_t structural = strings | block.eq('{') | block.eq('}');
+        if (escaped) {
+            structural &= ~1u;
+            strings &= ~1u;
+            escaped = false;
+        }
+        if (in_string && !strings) {
+            // braces inside a string are not structural
+            p += detail::Block::size;
+            continue;
+        }
+        while (structural) {
+            auto i = std::countr_zero(structural);
+            structural &= structural - 1;
+            if (on_char(p + i)) {
+                if (i + 1 < static_cast<int>(detail::Block::size)) {
+                    structural &= ~(1u << (i + 1));
+                }
+                else {
+                    escaped = true;
+                }
+            }
+        }
+        p += detail::Block::size;
+    }
+
+    if (escaped) {
+        ++p;
+    }
+    for (; p < end; ++p) {
+        if (on_char(p)) {
+            ++p;
+        }
+    }
+    // Outside of any string and object at the end, so a last ']' closes the array. Objects of a frame
+    // cut off between them are complete, only the missing ']' tells.
+    auto last = detail::trimWhitespace(data, end);
+    return depth == 0 && !in_string && last[-1] == ']';
+}
+
+}
@@ -0,0 +1,157 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <string>
+
+namespace websocket_proxy {
+
+inline uint64_t get_monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Percentiles of a LatencyHistogram in ns, small enough to be sent in a Message
+struct LatencyStats {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+
+    // keeps the higher of each value, e.g. the worst of several clients
+    void worst(const LatencyStats& other) noexcept {
+        count = count > other.count ? count : other.count;
+        p50 = p50 > other.p50 ? p50 : other.p50;
+        p90 = p90 > other.p90 ? p90 : other.p90;
+        p99 = p99 > other.p99 ? p99 : other.p99;
+        p999 = p999 > other.p999 ? p999 : other.p999;
+        max = max > other.max ? max : other.max;
+    }
+
+    std::string summary() const {
+        return std::format("count={} p50={:.1f}us p90={:.1f}us p99={:.1f}us p99.9={:.1f}us max={:.1f}us",
+            count, p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, p999 / 1000.0, max / 1000.0);
+    }
+};
+
+// HDR style latency histogram with 16 linear sub-buckets per power of two (~6% precision).
+// record() is lock-free and can run concurrently with readers on other threads.
+class LatencyHistogram {
+public:
+    static constexpr uint32_t kSubBucketBits = 4;
+    static constexpr uint32_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr uint32_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) noexcept {
+        buckets_[index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        auto max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+    // Returns the highest value equivalent to the given percentile (0-100).
+    uint64_t percentile(double p) const noexcept {
+        auto total = count();
+        if (!total) {
+            return 0;
+        }
+        auto target = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+        if (target == 0) {
+            target = 1;
+        }
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                auto value = highestEquivalent(i);
+                return value < max() ? value : max();
+            }
+        }
+        return max();
+    }
+
+    // Adds the samples of other, e.g. to aggregate the histograms of several threads or processes.
+    void merge(const LatencyHistogram& other) noexcept {
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            if (auto n = other.buckets_[i].load(std::memory_order_relaxed)) {
+                buckets_[i].fetch_add(n, std::memory_order_relaxed);
+            }
+        }
+        count_.fetch_add(other.count(), std::memory_order_relaxed);
+        auto value = other.max();
+        auto max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    void reset() noexcept {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    LatencyStats stats() const noexcept {
+        return LatencyStats{ count(), percentile(50), percentile(90), percentile(99), percentile(99.9), max() };
+    }
+
+    // Summary of nanosecond samples, e.g. "count=1000 p50=1.2us p99=4.8us p99.9=10.1us max=15.0us"
+    std::string summary() const {
+        return stats().summary();
+    }
+
+    static uint32_t index(uint64_t value) noexcept {
+        if (value < kSubBuckets) {
+            return static_cast<uint32_t>(value);
+        }
+        uint32_t msb = 63 - std::countl_zero(value);
+        uint32_t sub = static_cast<uint32_t>(value >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+        return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+
+    static uint64_t highestEquivalent(uint32_t index) noexcept {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        uint32_t msb = index / kSubBuckets + kSubBucketBits - 1;
+        uint64_t sub = index % kSubBuckets;
+        auto shift = msb - kSubBucketBits;
+        return (((kSubBuckets + sub) << shift) - 1) + (1ull << shift);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> max_{ 0 };
+};
+
+}
@@ -0,0 +1,193 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <websocket_proxy/types.h>
+#include <websocket_proxy/json_scanner.h>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace websocket_proxy::market_data {
+
+// Decodes Alpaca quote, trade and bar messages into QuoteMessage, TradeMessage and BarMessage.
+// Fields are located with the json scanner, nothing is allocated. Trade and quote conditions are dropped.
+
+inline bool parseDouble(std::string_view token, double& out) noexcept {
+    return !token.empty() && std::from_chars(token.data(), token.data() + token.size(), out).ec == std::errc();
+}
+
+inline bool parseUint(std::string_view token, uint64_t& out) noexcept {
+    return !token.empty() && std::from_chars(token.data(), token.data() + token.size(), out).ec == std::errc();
+}
+
+// RFC 3339 time, e.g. 2021-02-22T15:51:45.335689322Z or 2021-02-22T10:51:45-05:00, to ns since the epoch
+inline bool parseTimestamp(std::string_view s, uint64_t& ns) noexcept {
+    auto digits = [&s](size_t pos, size_t n, int64_t& out) {
+        if (pos + n > s.size()) {
+            return false;
+        }
+        out = 0;
+        for (size_t i = pos; i < pos + n; ++i) {
+            if (s[i] < '0' || s[i] > '9') {
+                return false;
+            }
+            out = out * 10 + (s[i] - '0');
+        }
+        return true;
+    };
+
+    int64_t y, mo, d, h, mi, sec;
+    if (s.size() < 19 || !digits(0, 4, y) || s[4] != '-' || !digits(5, 2, mo) || s[7] != '-' || !digits(8, 2, d) ||
+        (s[10] != 'T' && s[10] != 't' && s[10] != ' ') || !digits(11, 2, h) || s[13] != ':' || !digits(14, 2, mi) ||
+        s[16] != ':' || !digits(17, 2, sec) || mo < 1 || mo > 12) {
+        return false;
+    }
+
+    size_t pos = 19;
+    uint64_t frac = 0;
+    int frac_digits = 0;
+    if (pos < s.size() && s[pos] == '.') {
+        for (++pos; pos < s.size() && s[pos] >= '0' && s[pos] <= '9'; ++pos) {
+            if (frac_digits < 9) {
+                frac = frac * 10 + (s[pos] - '0');
+                ++frac_digits;
+            }
+        }
+    }
+    for (; frac_digits < 9; ++frac_digits) {
+        frac *= 10;
+    }
+
+    int64_t offset = 0;
+    if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) {
+        int64_t oh, om;
+        if (!digits(pos + 1, 2, oh) || pos + 3 >= s.size() || s[pos + 3] != ':' || !digits(pos + 4, 2, om)) {
+            return false;
+        }
+        offset = (oh * 60 + om) * 60 * (s[pos] == '+' ? 1 : -1);
+    }
+
+    // days since the epoch of the civil date
+    y -= mo <= 2;
+    auto era = (y >= 0 ? y : y - 399) / 400;
+    auto yoe = y - era * 400;
+    auto doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    auto days = era * 146097 + doe - 719468;
+
+    auto secs = days * 86400 + h * 3600 + mi * 60 + sec - offset;
+    if (secs < 0) {
+        return false;
+    }
+    ns = static_cast<uint64_t>(secs) * 1000000000ULL + frac;
+    return true;
+}
+
+template<size_t N>
+inline bool copySymbol(std::string_view symbol, char (&out)[N]) noexcept {
+    if (symbol.empty() || symbol.size() >= N) {
+        return false;
+    }
+    memset(out, 0, N);
+    memcpy(out, symbol.data(), symbol.size());
+    return true;
+}
+
+// first character of an optional string field, e.g. an exchange code
+inline char charField(const char* obj, const char* end, std::string_view quoted_key) noexcept {
+    auto value = json::findStringField(obj, end, quoted_key);
+    return value.empty() ? 0 : value[0];
+}
+
+// e.g. {"T":"q","S":"AAPL","bx":"V","bp":150.1,"bs":1,"ax":"V","ap":150.2,"as":2,"c":["R"],"z":"C","t":"2021-02-22T15:51:45.335689322Z"}
+inline bool decodeQuote(const char* obj, const char* end, QuoteMessage& out) noexcept {
+    out.bid_exchange = charField(obj, end, "\"bx\"");
+    out.ask_exchange = charField(obj, end, "\"ax\"");
+    out.tape = charField(obj, end, "\"z\"");
+    return copySymbol(json::findStringField(obj, end, "\"S\""), out.symbol) &&
+        parseDouble(json::findNumberField(obj, end, "\"bp\""), out.bid_price) &&
+        parseDouble(json::findNumberField(obj, end, "\"bs\""), out.bid_size) &&
+        parseDouble(json::findNumberField(obj, end, "\"ap\""), out.ask_price) &&
+        parseDouble(json::findNumberField(obj, end, "\"as\""), out.ask_size) &&
+        parseTimestamp(json::findStringField(obj, end, "\"t\""), out.timestamp);
+}
+
+// e.g. {"T":"t","S":"AAPL","i":52983525029461,"x":"V","p":126.55,"s":1,"c":["@","I"],"z":"C","t":"2021-02-22T15:51:44.208Z"}
+inline bool decodeTrade(const char* obj, const char* end, TradeMessage& out) noexcept {
+    out.exchange = charField(obj, end, "\"x\"");
+    out.tape = charField(obj, end, "\"z\"");
+    return copySymbol(json::findStringField(obj, end, "\"S\""), out.symbol) &&
+        parseUint(json::findNumberField(obj, end, "\"i\""), out.trade_id) &&
+        parseDouble(json::findNumberField(obj, end, "\"p\""), out.price) &&
+        parseDouble(json::findNumberField(obj, end, "\"s\""), out.size) &&
+        parseTimestamp(json::findStringField(obj, end, "\"t\""), out.timestamp);
+}
+
+// e.g. {"T":"b","S":"SPY","o":388.985,"h":389.13,"l":388.975,"c":389.12,"v":49378,"t":"2021-02-22T19:15:00Z","n":461,"vw":389.062639}
+inline bool decodeBar(const char* obj, const char* end, BarMessage& out) noexcept {
+    return copySymbol(json::findStringField(obj, end, "\"S\""), out.symbol) &&
+        parseDouble(json::findNumberField(obj, end, "\"o\""), out.open) &&
+        parseDouble(json::findNumberField(obj, end, "\"h\""), out.high) &&
+        parseDouble(json::findNumberField(obj, end, "\"l\""), out.low) &&
+        parseDouble(json::findNumberField(obj, end, "\"c\""), out.close) &&
+        parseDouble(json::findNumberField(obj, end, "\"v\""), out.volume) &&
+        parseDouble(json::findNumberField(obj, end, "\"vw\""), out.vwap) &&
+        parseUint(json::findNumberField(obj, end, "\"n\""), out.trade_count) &&
+        parseTimestamp(json::findStringField(obj, end, "\"t\""), out.timestamp);
+}
+
+template<typename T>
+inline T& header(T& record, uint64_t id, uint64_t recv_time) noexcept {
+    record.id = id;
+    record.recv_time = recv_time;
+    return record;
+}
+
+// Decodes a single message object of websocket id. Returns false for anything but a complete quote,
+// trade or bar, e.g. a status message or a symbol too long for the record.
+inline bool decode(const char* obj, size_t len, uint64_t id, uint64_t recv_time, Message::Type& type, MarketData& out) noexcept {
+    auto end = obj + len;
+    auto kind = json::findStringField(obj, end, "\"T\"");
+    if (kind.size() != 1) {
+        return false;
+    }
+    switch (kind[0]) {
+    case 'q':
+        type = Message::Type::Quote;
+        return decodeQuote(obj, end, header(out.quote, id, recv_time));
+    case 't':
+        type = Message::Type::Trade;
+        return decodeTrade(obj, end, header(out.trade, id, recv_time));
+    case 'b':
+    case 'd':
+    case 'u':
+        type = Message::Type::Bar;
+        header(out.bar, id, recv_time).kind = kind[0];
+        return decodeBar(obj, end, out.bar);
+    default:
+        return false;
+    }
+}
+
+}
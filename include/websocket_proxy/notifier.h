@@ -0,0 +1,218 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace websocket_proxy {
+
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Cross-process wakeup for queue readers that block when the queue is idle.
+// Writers call notify() after publishing; it only enters the kernel when a reader is waiting.
+// Readers that may block call registerWaiter() first, notify() costs a relaxed load while none is registered.
+// Every waiting reader is woken, so one notifier can serve several readers of a queue.
+// Backed by a futex in shared memory on Linux and a named semaphore on Windows.
+class Notifier {
+    struct State {
+        std::atomic<uint32_t> seq{ 0 };
+        std::atomic<uint32_t> waiters{ 0 };
+        // readers that may block, see registerWaiter()
+        std::atomic<uint32_t> registered{ 0 };
+    };
+
+    State* state_ = nullptr;
+    std::string name_;
+    bool own_ = false;
+    bool registered_ = false;
+#ifdef _WIN32
+    HANDLE hMapFile_ = nullptr;
+    HANDLE semaphore_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+public:
+    // The owner creates the notifier, the other side opens it. Throws std::runtime_error on failure.
+    Notifier(const char* name, bool create)
+        : name_(name)
+        , own_(create)
+    {
+#ifdef _WIN32
+        auto state_name = name_ + "_state";
+        auto semaphore_name = name_ + "_semaphore";
+        if (create) {
+            hMapFile_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(State), state_name.c_str());
+            semaphore_ = CreateSemaphoreA(NULL, 0, LONG_MAX, semaphore_name.c_str());
+        }
+        else {
+            hMapFile_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, state_name.c_str());
+            semaphore_ = OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, semaphore_name.c_str());
+        }
+        if (!hMapFile_ || !semaphore_) {
+            auto err = GetLastError();
+            release();
+            throw std::runtime_error("Failed to open notifier " + name_ + ". err=" + std::to_string(err));
+        }
+        auto mem = MapViewOfFile(hMapFile_, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(State));
+#else
+        auto shm_name = "/" + name_;
+        fd_ = shm_open(shm_name.c_str(), create ? (O_CREAT | O_RDWR) : O_RDWR, 0600);
+        if (fd_ < 0 || (create && ftruncate(fd_, sizeof(State)) != 0)) {
+            auto err = errno;
+            release();
+            throw std::runtime_error("Failed to open notifier " + name_ + ". err=" + std::to_string(err));
+        }
+        auto mem = mmap(nullptr, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mem == MAP_FAILED) {
+            mem = nullptr;
+        }
+#endif
+        if (!mem) {
+            release();
+            throw std::runtime_error("Failed to map notifier " + name_);
+        }
+        state_ = create ? new (mem) State() : reinterpret_cast<State*>(mem);
+    }
+
+    ~Notifier() {
+        release();
+    }
+
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    // Announces that this side will wait(). Until then notify() doesn't fence. Notifications issued
+    // before the registration is visible may be missed, the wait times out then.
+    void registerWaiter() noexcept {
+        if (!registered_) {
+            registered_ = true;
+            state_->registered.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Wakes up the waiting readers, if any. Call after the message is published.
+    void notify() noexcept {
+        if (!state_->registered.load(std::memory_order_relaxed)) {
+            return;
+        }
+        // pairs with the fence in wait(): either we see the waiter or it sees the published message
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto waiters = state_->waiters.load(std::memory_order_relaxed);
+        if (waiters) {
+            state_->seq.fetch_add(1, std::memory_order_release);
+#ifdef _WIN32
+            // a waiter that timed out meanwhile leaves a count behind, its next wait returns early
+            ReleaseSemaphore(semaphore_, static_cast<LONG>(waiters), nullptr);
+#else
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_->seq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+    }
+
+    // Blocks until notified or timed out, unless ready() becomes true first.
+    // ready() must check for a published message without consuming it.
+    // Returns true if woken up by a notification.
+    template<typename Ready>
+    bool wait(Ready&& ready, uint32_t timeout_ms) noexcept {
+        auto seq = state_->seq.load(std::memory_order_acquire);
+        state_->waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool notified = false;
+        if (!ready()) {
+#ifdef _WIN32
+            notified = WaitForSingleObject(semaphore_, timeout_ms) == WAIT_OBJECT_0;
+#else
+            timespec ts{ static_cast<time_t>(timeout_ms / 1000), static_cast<long>(timeout_ms % 1000) * 1000000 };
+            notified = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_->seq), FUTEX_WAIT, seq, &ts, nullptr, 0) == 0
+                || errno == EAGAIN;
+#endif
+        }
+        state_->waiters.fetch_sub(1, std::memory_order_relaxed);
+        return notified;
+    }
+
+private:
+    void release() noexcept {
+        if (state_ && registered_) {
+            registered_ = false;
+            state_->registered.fetch_sub(1, std::memory_order_relaxed);
+        }
+#ifdef _WIN32
+        if (state_) {
+            UnmapViewOfFile(state_);
+            state_ = nullptr;
+        }
+        if (semaphore_) {
+            CloseHandle(semaphore_);
+            semaphore_ = nullptr;
+        }
+        if (hMapFile_) {
+            CloseHandle(hMapFile_);
+            hMapFile_ = nullptr;
+        }
+#else
+        if (state_) {
+            munmap(state_, sizeof(State));
+            state_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+            if (own_) {
+                shm_unlink(("/" + name_).c_str());
+            }
+        }
+#endif
+    }
+};
+
+}
@@ -0,0 +1,389 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <tlhelp32.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <fstream>
+extern char** environ;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WEBSOCKET_PROXY_PROCESS_NAME "websocket_proxy.exe"
+#else
+#define WEBSOCKET_PROXY_PROCESS_NAME "websocket_proxy"
+#endif
+
+namespace websocket_proxy {
+
+inline uint64_t getCurrentProcessId() noexcept {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<uint64_t>(getpid());
+#endif
+}
+
+// Isolates the shared memory of different logon sessions on Windows and different users on Linux
+inline uint64_t getSessionId() {
+#ifdef _WIN32
+    DWORD session_id;
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), &session_id)) {
+        throw std::runtime_error("Failed to get session ID. err=" + std::to_string(GetLastError()));
+    }
+    return session_id;
+#else
+    return static_cast<uint64_t>(getuid());
+#endif
+}
+
+#ifndef _WIN32
+// State letter from /proc/<pid>/stat, 0 if the process doesn't exist
+inline char getProcessState(uint64_t pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return 0;
+    }
+    // the process name is in parentheses and may contain spaces
+    auto pos = line.rfind(')');
+    return (pos != std::string::npos && pos + 2 < line.size()) ? line[pos + 2] : 0;
+}
+#endif
+
+inline bool isProcessRunning(uint64_t processID) {
+#ifdef _WIN32
+    bool running = false;
+    if (HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, (DWORD)processID)) {
+        DWORD exitCodeOut;
+        // GetExitCodeProcess returns zero on failure
+        if (GetExitCodeProcess(process, &exitCodeOut)) {
+            running = exitCodeOut == STILL_ACTIVE;
+        }
+        CloseHandle(process);
+    }
+    return running;
+#else
+    if (kill(static_cast<pid_t>(processID), 0) != 0 && errno != EPERM) {
+        return false;
+    }
+    // a zombie has exited, e.g. a child not reaped yet
+    auto state = getProcessState(processID);
+    return state != 0 && state != 'Z' && state != 'X';
+#endif
+}
+
+inline bool isProcessRunning(const char* name) {
+    bool exists = false;
+#ifdef _WIN32
+    std::wstring wname(name, name + strlen(name));
+    PROCESSENTRY32W entry;
+    entry.dwSize = sizeof(PROCESSENTRY32W);
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, NULL);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    if (Process32FirstW(snapshot, &entry)) {
+        do {
+            if (!_wcsicmp(entry.szExeFile, wname.c_str())) {
+                exists = true;
+                break;
+            }
+        } while (Process32NextW(snapshot, &entry));
+    }
+    CloseHandle(snapshot);
+#else
+    // /proc/<pid>/comm is truncated to 15 characters
+    std::string comm_name(name, strnlen(name, 15));
+    DIR* proc = opendir("/proc");
+    if (!proc) {
+        return false;
+    }
+    while (auto entry = readdir(proc)) {
+        char* end = nullptr;
+        auto pid = strtoull(entry->d_name, &end, 10);
+        if (!pid || *end) {
+            continue;
+        }
+        std::ifstream comm(std::string("/proc/") + entry->d_name + "/comm");
+        std::string process_name;
+        if (std::getline(comm, process_name) && process_name == comm_name && isProcessRunning(pid)) {
+            exists = true;
+            break;
+        }
+    }
+    closedir(proc);
+#endif
+    return exists;
+}
+
+// Starts exe detached from the calling process. args are separated by whitespace.
+// Returns false and sets err on failure.
+inline bool spawnProcess(const std::filesystem::path& exe, const std::string& args, std::string& err) {
+#ifdef _WIN32
+    STARTUPINFOW si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+
+    // CreateProcessW may modify the command line buffer
+    std::wstring cmd_line = L"\"" + exe.wstring() + L"\" " + std::wstring(args.begin(), args.end());
+    if (!CreateProcessW(exe.c_str(), cmd_line.data(), NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &si, &pi)) {
+        err = "err=" + std::to_string(GetLastError());
+        return false;
+    }
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return true;
+#else
+    auto exe_path = exe.string();
+    std::vector<std::string> tokens{ exe_path };
+    std::istringstream iss(args);
+    for (std::string token; iss >> token;) {
+        tokens.emplace_back(std::move(token));
+    }
+    std::vector<char*> argv;
+    for (auto& token : tokens) {
+        argv.emplace_back(token.data());
+    }
+    argv.emplace_back(nullptr);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+    // don't take the proxy down with the client's terminal session
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+#endif
+    pid_t pid;
+    auto rc = posix_spawn(&pid, exe_path.c_str(), nullptr, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        err = std::string(strerror(rc));
+        return false;
+    }
+    // reaped once it exits, it would stay a zombie as long as the caller runs
+    std::thread([pid]() { waitpid(pid, nullptr, 0); }).detach();
+    return true;
+#endif
+}
+
+// Pins the calling thread to a core. Returns false on failure, e.g. no such core.
+inline bool setThreadAffinity(uint32_t core) noexcept {
+#ifdef _WIN32
+    return core < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#else
+    if (core >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// Runs the calling thread with real-time priority, SCHED_FIFO at priority on Linux (usually needs
+// CAP_SYS_NICE) and time critical on Windows. Returns false on failure.
+inline bool setThreadRealtimePriority(int priority) noexcept {
+#ifdef _WIN32
+    (void)priority;
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+    sched_param param{};
+    param.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+}
+
+// Named shared memory segment. Opens the segment if it already exists, see created(), and with create
+// false only opens it. Throws std::runtime_error on failure.
+class SharedMemory {
+    std::string name_;
+    size_t size_ = 0;
+    void* data_ = nullptr;
+    bool created_ = false;
+#ifdef _WIN32
+    HANDLE hMapFile_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+public:
+    SharedMemory(const std::string& name, size_t size, bool create = true)
+        : name_(name)
+        , size_(size)
+    {
+#ifdef _WIN32
+        // Create a security descriptor that allows access only to current user
+        SECURITY_ATTRIBUTES sa;
+        SECURITY_DESCRIPTOR sd;
+        InitializeSecurityDescriptor(&sd, SECURITY_DESCRIPTOR_REVISION);
+        SetSecurityDescriptorDacl(&sd, TRUE, NULL, FALSE); // Allow current user only
+        sa.nLength = sizeof(sa);
+        sa.lpSecurityDescriptor = &sd;
+        sa.bInheritHandle = FALSE;
+
+        auto shm_name = "Local\\" + name_;
+        if (create) {
+            hMapFile_ = CreateFileMappingA(
+                INVALID_HANDLE_VALUE,   // use paging file
+                &sa,                    // default security
+                PAGE_READWRITE,         // read/write access
+                0,                      // maximum object size (high-order DWORD)
+                (DWORD)size_,           // maximum object size (low-order DWORD)
+                shm_name.c_str()        // name of mapping object
+            );
+            if (hMapFile_ == NULL) {
+                throw std::runtime_error("Failed to create shm " + name_ + ". err=" + std::to_string(GetLastError()));
+            }
+            created_ = GetLastError() != ERROR_ALREADY_EXISTS;
+        }
+        else {
+            hMapFile_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, shm_name.c_str());
+            if (hMapFile_ == NULL) {
+                throw std::runtime_error("Failed to open shm " + name_ + ". err=" + std::to_string(GetLastError()));
+            }
+        }
+
+        data_ = MapViewOfFile(hMapFile_, FILE_MAP_ALL_ACCESS, 0, 0, size_);
+        if (!data_) {
+            auto err = GetLastError();
+            release();
+            throw std::runtime_error("Failed to map shm " + name_ + ". err=" + std::to_string(err));
+        }
+#else
+        // owner read/write only
+        auto shm_name = "/" + name_;
+        fd_ = create ? shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : -1;
+        if (fd_ >= 0) {
+            created_ = true;
+            if (ftruncate(fd_, size_) != 0) {
+                auto err = errno;
+                release();
+                throw std::runtime_error("Failed to size shm " + name_ + ". err=" + std::to_string(err));
+            }
+        }
+        else if (!create || errno == EEXIST) {
+            fd_ = shm_open(shm_name.c_str(), O_RDWR, 0600);
+            // the creator may not have sized the segment yet
+            struct stat st{};
+            for (int retry = 0; fd_ >= 0 && fstat(fd_, &st) == 0 && (size_t)st.st_size < size_ && retry < 100; ++retry) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            if (fd_ >= 0 && (size_t)st.st_size < size_) {
+                release();
+                throw std::runtime_error("Failed to open shm " + name_ + ". Unexpected size " + std::to_string(st.st_size));
+            }
+        }
+        if (fd_ < 0) {
+            throw std::runtime_error((create ? "Failed to create shm " : "Failed to open shm ") + name_ + ". err=" + std::to_string(errno));
+        }
+
+        data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data_ == MAP_FAILED) {
+            auto err = errno;
+            data_ = nullptr;
+            release();
+            throw std::runtime_error("Failed to map shm " + name_ + ". err=" + std::to_string(err));
+        }
+#endif
+    }
+
+    ~SharedMemory() {
+        release();
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    void* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+
+    // true if this instance created the segment, it is zero initialized
+    bool created() const noexcept { return created_; }
+
+    // Unlinks a segment, e.g. one left by a process that died. Processes mapping it keep their mapping.
+    // Windows removes a mapping with its last handle, nothing to do there.
+    static void remove(const std::string& name) noexcept {
+#ifndef _WIN32
+        shm_unlink(("/" + name).c_str());
+#else
+        (void)name;
+#endif
+    }
+
+private:
+    void release() noexcept {
+#ifdef _WIN32
+        if (data_) {
+            UnmapViewOfFile(data_);
+            data_ = nullptr;
+        }
+        if (hMapFile_) {
+            CloseHandle(hMapFile_);
+            hMapFile_ = nullptr;
+        }
+#else
+        if (data_) {
+            munmap(data_, size_);
+            data_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+            // the Windows mapping goes away with its last handle, POSIX shm has to be unlinked
+            if (created_) {
+                shm_unlink(("/" + name_).c_str());
+            }
+        }
+#endif
+    }
+};
+
+}
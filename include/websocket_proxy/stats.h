@@ -0,0 +1,136 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <websocket_proxy/platform.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace websocket_proxy {
+
+// Read-only metrics the proxy publishes to shared memory every PROXY_STATS_INTERVAL,
+// e.g. for a monitoring sidecar. Updated on the proxy's control thread from counters
+// it keeps anyway, readers never block the proxy.
+#define PROXY_STATS_INTERVAL 500    // 500ms
+#define PROXY_STATS_VERSION 2
+
+constexpr uint32_t kMaxStatsWebsockets = 64;
+constexpr uint32_t kMaxStatsClients = 256;
+
+inline std::string proxyStatsName() {
+    return "WebsocketProxy_" + std::to_string(getSessionId()) + "_stats";
+}
+
+struct QueueStats {
+    uint64_t size;          // bytes
+    uint64_t head;          // next write index
+    uint64_t occupancy;     // bytes between the slowest reader and head, capped at size
+};
+
+struct WebsocketStats {
+    uint64_t id;
+    char url[256];
+    uint8_t status;         // 0 connecting, 1 connected, 2 disconnecting, 3 disconnected, 4 reconnecting
+    uint32_t clients;
+    uint64_t frames_read;   // complete messages
+    uint64_t bytes_read;
+    uint64_t frames_written;
+    uint64_t bytes_written;
+    uint64_t reconnects;    // times the connection was reestablished after dropping
+    uint64_t write_queue_depth;
+    uint64_t write_queue_bytes;
+};
+
+struct ClientStats {
+    uint64_t pid;
+    char name[32];
+    uint32_t slot;
+    uint64_t last_heartbeat_time;   // ms since epoch
+    // from the client's last heartbeat
+    uint64_t messages_consumed;
+    uint64_t server_queue_lag;      // bytes behind the server queue head
+    uint64_t data_queue_lag;        // bytes behind its data queue head, routing only
+    uint64_t overruns;              // times it fell more than a queue size behind
+};
+
+struct ProxyStats {
+    // odd while the proxy updates the snapshot, see ProxyStatsReader
+    std::atomic<uint64_t> seq;
+    uint32_t version;
+    uint64_t pid;
+    uint64_t update_time;           // ms since epoch
+    QueueStats server_queue;
+    QueueStats client_queue;
+    uint32_t websocket_count;
+    uint32_t client_count;
+    WebsocketStats websockets[kMaxStatsWebsockets];
+    ClientStats clients[kMaxStatsClients];
+};
+
+// Opens the stats segment of the proxy running in this session. Throws std::runtime_error if there is none.
+class ProxyStatsReader {
+    std::unique_ptr<SharedMemory> shm_;
+    const ProxyStats* stats_ = nullptr;
+
+public:
+    ProxyStatsReader() {
+        if (!isProcessRunning(WEBSOCKET_PROXY_PROCESS_NAME)) {
+            throw std::runtime_error("websocket_proxy is not running");
+        }
+        try {
+            // only opened, a segment created here could be the one the proxy is about to open
+            shm_ = std::make_unique<SharedMemory>(proxyStatsName(), sizeof(ProxyStats), false);
+        }
+        catch (const std::runtime_error&) {
+            throw std::runtime_error("websocket_proxy stats not found");
+        }
+        stats_ = static_cast<const ProxyStats*>(shm_->data());
+    }
+
+    // Copies a consistent snapshot. Returns false if the proxy kept updating it.
+    bool read(ProxyStats& out, uint32_t retries = 100) const {
+        return readSnapshot(*stats_, out, retries);
+    }
+
+    // Copies stats into out unless the writer is updating them, retrying up to retries times.
+    // Returns false if it never got a consistent copy or the copy is of another version.
+    static bool readSnapshot(const ProxyStats& stats, ProxyStats& out, uint32_t retries) {
+        while (retries--) {
+            auto seq = stats.seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            memcpy(static_cast<void*>(&out), static_cast<const void*>(&stats), sizeof(ProxyStats));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stats.seq.load(std::memory_order_relaxed) == seq) {
+                return out.version == PROXY_STATS_VERSION;
+            }
+        }
+        return false;
+    }
+};
+
+}
@@ -0,0 +1,196 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <websocket_proxy/json_scanner.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace websocket_proxy {
+
+// A set of symbols checked against every frame a client receives. Symbols are stored inline
+// as fixed-width keys in an open addressing table at most a quarter full, so a lookup is a hash and
+// usually a single 24 byte compare, without touching the heap. Updated in place by insert and erase.
+class SymbolFilter {
+public:
+    static constexpr size_t kMaxLen = 23;
+
+    SymbolFilter() = default;
+
+    explicit SymbolFilter(const std::unordered_set<std::string>& symbols) {
+        for (auto& symbol : symbols) {
+            insert(symbol);
+        }
+    }
+
+    // Returns false if the symbol was already in the set
+    bool insert(std::string_view symbol) {
+        if (symbol.empty()) {
+            return false;
+        }
+        if (symbol.size() > kMaxLen) {
+            // can't be keyed, let everything through rather than drop its data
+            ++long_symbols_;
+            return true;
+        }
+        if ((size_ + 1) * 4 > keys_.size()) {
+            rehash(keys_.size() * 2);
+        }
+        auto key = makeKey(symbol);
+        for (auto i = hashOf(key) & mask_;; i = (i + 1) & mask_) {
+            if (keys_[i].empty()) {
+                keys_[i] = key;
+                ++size_;
+                return true;
+            }
+            if (keys_[i] == key) {
+                return false;
+            }
+        }
+    }
+
+    // Returns false if the symbol wasn't in the set
+    bool erase(std::string_view symbol) noexcept {
+        if (symbol.empty()) {
+            return false;
+        }
+        if (symbol.size() > kMaxLen) {
+            if (!long_symbols_) {
+                return false;
+            }
+            --long_symbols_;
+            return true;
+        }
+        auto key = makeKey(symbol);
+        auto i = hashOf(key) & mask_;
+        for (;; i = (i + 1) & mask_) {
+            if (keys_[i].empty()) {
+                return false;
+            }
+            if (keys_[i] == key) {
+                break;
+            }
+        }
+        // backward shift deletion, moves later keys of the probe sequence into the hole
+        for (auto j = (i + 1) & mask_; !keys_[j].empty(); j = (j + 1) & mask_) {
+            auto home = hashOf(keys_[j]) & mask_;
+            // j's key stays unless its home slot is cyclically outside (i, j]
+            if (((j - home) & mask_) >= ((j - i) & mask_)) {
+                keys_[i] = keys_[j];
+                i = j;
+            }
+        }
+        keys_[i] = Key{};
+        --size_;
+        return true;
+    }
+
+    size_t size() const noexcept { return size_ + long_symbols_; }
+
+    bool contains(std::string_view symbol) const noexcept {
+        if (long_symbols_) {
+            return true;
+        }
+        if (symbol.empty() || symbol.size() > kMaxLen) {
+            return false;
+        }
+        auto key = makeKey(symbol);
+        for (auto i = hashOf(key) & mask_;; i = (i + 1) & mask_) {
+            if (keys_[i] == key) {
+                return true;
+            }
+            if (keys_[i].empty()) {
+                return false;
+            }
+        }
+    }
+
+    // True if the frame has no "S" field, e.g. a control message, or any of its symbols is in the set.
+    // Stops at the first match.
+    bool passes(const char* data, size_t len) const noexcept {
+        const char* p = data;
+        const char* end = data + len;
+        bool has_symbol = false;
+        while (p < end) {
+            auto symbol = json::findStringField(p, end, "\"S\"", &p);
+            if (symbol.data() == nullptr) {
+                break;
+            }
+            if (contains(symbol)) {
+                return true;
+            }
+            has_symbol = true;
+        }
+        return !has_symbol;
+    }
+
+private:
+    struct Key {
+        uint64_t words[3] = {};
+        // a symbol's first character is never 0
+        bool empty() const noexcept { return words[0] == 0; }
+        bool operator==(const Key&) const noexcept = default;
+    };
+
+    void rehash(size_t capacity) {
+        std::vector<Key> keys(std::max<size_t>(capacity, 8));
+        auto mask = keys.size() - 1;
+        for (auto& key : keys_) {
+            if (key.empty()) {
+                continue;
+            }
+            auto i = hashOf(key) & mask;
+            while (!keys[i].empty()) {
+                i = (i + 1) & mask;
+            }
+            keys[i] = key;
+        }
+        keys_ = std::move(keys);
+        mask_ = mask;
+    }
+
+    static Key makeKey(std::string_view symbol) noexcept {
+        Key key;
+        memcpy(key.words, symbol.data(), symbol.size());
+        return key;
+    }
+
+    static size_t hashOf(const Key& key) noexcept {
+        auto hash = (key.words[0] ^ (key.words[1] * 0x9E3779B97F4A7C15ULL) ^ (key.words[2] >> 7)) * 0xBF58476D1CE4E5B9ULL;
+        return static_cast<size_t>(hash ^ (hash >> 31));
+    }
+
+    // keys_.size() - 1, the size is a power of two
+    size_t mask_ = 0;
+    std::vector<Key> keys_ = std::vector<Key>(1);
+    size_t size_ = 0;
+    // symbols longer than kMaxLen, everything passes while there are any
+    uint32_t long_symbols_ = 0;
+};
+
+}
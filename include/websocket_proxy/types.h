@@ -22,18 +22,33 @@
 #pragma once
 
 #include <slick_queue/slick_queue.h>
+#include <websocket_proxy/latency_histogram.h>
 #include <atomic>
 #include <chrono>
+#include <cstring>
+#include <type_traits>
 
 namespace websocket_proxy {
 
 #define CLIENT_TO_SERVER_QUEUE "WebsocketProxy_client_server"
 #define SERVER_TO_CLIENT_QUEUE "WebsocketProxy_server_client"
+#define CLIENT_DATA_QUEUE_PREFIX "WebsocketProxy_client_data_"
+#define CLIENT_TO_SERVER_NOTIFIER "WebsocketProxy_client_server_notifier"
+#define SERVER_TO_CLIENT_NOTIFIER "WebsocketProxy_server_client_notifier"
+#define CLIENT_STATUS_SEGMENT "WebsocketProxy_client_status"
 #define HEARTBEAT_INTERVAL 500  // 500ms
 #define HEARTBEAT_TIMEOUT 15000 // 15s
+#define STATS_INTERVAL 1000     // 1s, clients report their latencies to the proxy
+#define AUTH_TIMEOUT 10000      // 10s, for the upstream reply to a proxy owned authentication
 
+// Max clients registered with one proxy, every client gets a slot. A client registering beyond it is
+// refused. Every subscription table entry holds a few bits per slot, see SubscriptionTable.
+constexpr uint32_t kMaxClients = 256;
+
+#ifdef _MSC_VER
 #pragma warning( push )
 #pragma warning( disable : 4200 )
+#endif
 
 #pragma pack(1)
 struct Message {
@@ -49,6 +64,12 @@ struct Message {
         Subscribe,
         Unsubscribe,
         LogLevel,
+        Stats,
+        ReconnectWs,
+        Auth,
+        Quote,
+        Trade,
+        Bar,
     };
 
     enum Status : uint8_t {
@@ -60,6 +81,7 @@ struct Message {
     uint64_t pid;
     Type type;
     std::atomic<Status> status;
+    uint64_t timestamp;     // steady clock ns when published
     uint8_t data[0];
 };
 
@@ -68,6 +90,20 @@ struct RegisterMessage {
     // response
     uint64_t server_pid;
     char err[256];
+    // name of the client's own data queue, empty if the server broadcasts all data
+    char data_queue[64];
+    // the client's entry in the CLIENT_STATUS_SEGMENT
+    uint32_t slot;
+    // quotes, trades and bars arrive as binary records, see market_data.h
+    bool binary_market_data;
+};
+
+// Sent by clients, the proxy publishes it in its stats segment, see stats.h
+struct HeartbeatMessage {
+    // read positions of the client, bytes
+    uint64_t server_queue_cursor;
+    uint64_t data_queue_cursor;
+    uint64_t messages_consumed;
 };
 
 struct WsOpen {
@@ -97,6 +133,8 @@ struct WsSubscription {
     uint32_t request_len;
     bool existing;
     SubscriptionType type;
+    // deliver the symbol's quotes to this client at most once per interval, only the latest. 0 delivers every quote
+    uint32_t conflate_ms;
     char request[0];
 };
 
@@ -106,19 +144,98 @@ struct WsRequest {
     char data[0];
 };
 
+// Authenticates a websocket through the proxy, once per url and api key, see WebsocketProxyClient::authenticate
+struct WsAuth {
+    uint64_t id;
+    char success[64];       // an upstream frame containing this completes the authentication
+    char failure[64];       // an upstream frame containing this fails it
+    // response, the upstream reply, truncated
+    uint32_t response_len;
+    char response[1024];
+    uint32_t request_len;
+    char request[0];
+};
+
+// The proxy lost the connection and is reconnecting, or reconnected and replayed the subscriptions.
+// The websocket keeps its id.
+struct WsReconnect {
+    uint64_t id;
+    bool connected;
+};
+
 struct WsError {
     uint64_t id;
     uint32_t len;
     char err[0];
 };
 
+// Reported by the proxy to a client whose read cursor fell behind a queue head,
+// by more than the queue size its unread data has been overwritten. See ClientStatus.
+struct OverrunMessage {
+    uint64_t client_pid;
+    uint64_t lag;           // bytes behind the queue head
+    uint64_t queue_size;
+    bool data_queue;        // the client's own data queue, otherwise the server queue
+    bool disconnected;      // over the proxy's lag budget, the client has been unregistered
+};
+
 struct WsData {
     uint64_t id;
     uint32_t len;
     uint32_t remaining;
+    uint64_t recv_time;     // steady clock ns the proxy read the data from the websocket
     char data[0];
 };
 
+// Normalized market data, published instead of WsData when the proxy decodes it, see market_data.h.
+// timestamp is the feed's time in ns since the epoch, recv_time the steady clock ns the proxy read it.
+struct QuoteMessage {
+    uint64_t id;            // websocket
+    uint64_t recv_time;
+    uint64_t timestamp;
+    char symbol[24];
+    double bid_price;
+    double bid_size;
+    double ask_price;
+    double ask_size;
+    char bid_exchange;
+    char ask_exchange;
+    char tape;
+};
+
+struct TradeMessage {
+    uint64_t id;
+    uint64_t recv_time;
+    uint64_t timestamp;
+    char symbol[24];
+    uint64_t trade_id;
+    double price;
+    double size;
+    char exchange;
+    char tape;
+};
+
+struct BarMessage {
+    uint64_t id;
+    uint64_t recv_time;
+    uint64_t timestamp;     // start of the bar
+    char symbol[24];
+    double open;
+    double high;
+    double low;
+    double close;
+    double volume;
+    double vwap;
+    uint64_t trade_count;
+    char kind;              // 'b' minute, 'd' daily, 'u' updated bar
+};
+
+union MarketData {
+    QuoteMessage quote;
+    TradeMessage trade;
+    BarMessage bar;
+};
+
 struct LogLevel {
     enum level_enum : uint8_t {
         trace = 0,
@@ -133,9 +250,76 @@ struct LogLevel {
 
     level_enum level;
 };
+// Latencies in ns. Clients send their own periodically, any client can query the proxy's.
+struct StatsMessage {
+    // the sender's latencies
+    LatencyStats queue_residency;   // published by the proxy -> read by the client
+    LatencyStats callback;          // WebsocketProxyCallback::onWebsocketData duration
+    // answer with the proxy's latencies, the periodic reports don't wait for one
+    bool reply;
+    // reset the proxy's histograms after answering
+    bool reset;
+    // response
+    LatencyStats request;           // client request published -> handled by the proxy
+    LatencyStats read;              // read from a websocket -> published to the clients
+    LatencyStats write;             // queued -> written to a websocket
+    // highest values reported by any client
+    LatencyStats client_queue_residency;
+    LatencyStats client_callback;
+    uint32_t clients;
+};
 #pragma pack()
+#ifdef _MSC_VER
 #pragma warning( pop )
+#endif
 
 typedef slick::SlickQueue<uint8_t> SHM_QUEUE_T;
 
+// Per client slot entry of the CLIENT_STATUS_SEGMENT. Notices for a client that has fallen behind
+// can't go through the queues it is behind on, the client checks its entry before reading them.
+// seq is odd while the proxy writes the notice and changes with every notice.
+struct alignas(64) ClientStatus {
+    std::atomic<uint64_t> seq;
+    OverrunMessage overrun;
+};
+
+template<typename T>
+inline uint32_t get_message_size(uint32_t data_len = 0) {
+    if constexpr (std::is_void_v<T>) {
+        return sizeof(Message) + data_len;
+    }
+    else {
+        return sizeof(Message) + sizeof(T) + data_len;
+    }
+}
+
+// Stamps Message::timestamp and publishes the message
+inline void publishMessage(SHM_QUEUE_T& queue, Message* msg, uint64_t index, uint32_t size) {
+    msg->timestamp = get_monotonic_ns();
+    queue.publish(index, size);
+}
+
+// A message reserved in a queue, body points to the T following the Message header
+template<typename T>
+struct MessageSlot {
+    Message* msg;
+    T* body;
+    uint64_t index;
+    uint32_t size;
+};
+
+// Reserves a Message with a T body followed by data_len payload bytes, T = void for a bare message.
+// Only the Message header and the fixed fields of T are zeroed, the writer fills the payload.
+template<typename T = void>
+inline MessageSlot<T> reserveMessageSlot(SHM_QUEUE_T& queue, uint64_t pid, Message::Type type, uint32_t data_len = 0) {
+    auto size = get_message_size<T>(data_len);
+    auto index = queue.reserve(size);
+    auto ptr = queue[index];
+    memset(ptr, 0, size - data_len);
+    auto msg = reinterpret_cast<Message*>(ptr);
+    msg->pid = pid;
+    msg->type = type;
+    return MessageSlot<T>{ msg, static_cast<T*>(static_cast<void*>(msg->data)), index, size };
+}
+
 }
\ No newline at end of file
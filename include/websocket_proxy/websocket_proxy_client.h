@@ -21,21 +21,23 @@
 
 #pragma once
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#include <tlhelp32.h>
-#endif
-
 #include <cstdint>
 #include <thread>
 #include <atomic>
 #include <unordered_set>
+#include <unordered_map>
+#include <string>
 #include <functional>
+#include <mutex>
 #include <filesystem>
 #include <format>
 
-#include <websocket_proxy\types.h>
+#include <websocket_proxy/platform.h>
+#include <websocket_proxy/types.h>
+#include <websocket_proxy/notifier.h>
+#include <websocket_proxy/latency_histogram.h>
+#include <websocket_proxy/market_data.h>
+#include <websocket_proxy/symbol_filter.h>
 
 namespace websocket_proxy {
 
@@ -46,7 +48,22 @@ public:
     virtual void onWebsocketOpened(uint64_t id) = 0;
     virtual void onWebsocketClosed(uint64_t id) = 0;
     virtual void onWebsocketError(uint64_t id, const char* err, uint32_t len) = 0;
+    // Large messages arrive in chunks, remaining is 0 on the last one. Chunks of different websockets may interleave.
     virtual void onWebsocketData(uint64_t id, const char* data, uint32_t len, uint32_t remaining) = 0;
+    // The proxy lost the upstream connection and is reconnecting (connected false), or reconnected and
+    // resubscribed (connected true). The id stays the same, data published upstream in between is missed.
+    virtual void onWebsocketReconnect(uint64_t /*id*/, bool /*connected*/) {}
+    // This client fell lag bytes behind a proxy queue of queue_size bytes, data it hadn't read was overwritten.
+    // When disconnected, the proxy unregistered it for exceeding its lag budget and onWebsocketProxyServerDisconnected follows.
+    virtual void onWebsocketProxyOverrun(uint64_t /*lag*/, uint64_t /*queue_size*/, bool /*disconnected*/) {}
+    // Decoded market data when the proxy runs with binary market data (-e), or when this client decodes
+    // the JSON itself, see WebsocketProxyClient::decodeMarketData. Otherwise the data arrives through onWebsocketData.
+    virtual void onQuote(const QuoteMessage& /*quote*/) {}
+    virtual void onTrade(const TradeMessage& /*trade*/) {}
+    virtual void onBar(const BarMessage& /*bar*/) {}
+    // With decodeMarketData, every other object of a frame, e.g. a success, error, subscription or trading status
+    // message. data is a single JSON object pointing into the queue, valid during the call.
+    virtual void onStatus(uint64_t /*id*/, const char* /*data*/, uint32_t /*len*/) {}
 
     // functions to pass log messages to client
     virtual void logError(std::function<std::string()>&&) {}
@@ -57,7 +74,15 @@ public:
 
 class WebsocketProxyClient {
 public:
-    WebsocketProxyClient(WebsocketProxyCallback* callback, std::string&& name, std::string &&proxy_exe_path);
+    // How the worker thread waits while its queues are empty
+    enum class WaitPolicy : uint8_t {
+        BusySpin,   // spin with a pause instruction. Lowest latency, keeps a core busy
+        Yield,      // spin yielding to other threads, the default
+        Block,      // spin for spin_us, then block until the proxy publishes. Frees the core while idle
+    };
+
+    // proxy_args are passed to the proxy server when this client spawns it, e.g. "-r" to enable symbol routing
+    WebsocketProxyClient(WebsocketProxyCallback* callback, std::string&& name, std::string &&proxy_exe_path, std::string&& proxy_args = "");
     virtual ~WebsocketProxyClient();
 
     uint64_t serverId() const noexcept { return server_pid_; }
@@ -65,11 +90,60 @@ public:
     std::pair<uint64_t, bool> openWebSocket(const std::string& url, const std::string &api_key);
     bool openWebSocketAsync(const std::string& url, const std::string &api_key);
     bool closeWebSocket(uint64_t id = 0);
-    bool subscribe(uint64_t id, const std::string& symbol, const char* subscription_request, uint32_t request_len, SubscriptionType type, bool& existing);
+    // conflate_ms > 0 delivers the symbol's quotes to this client at most once per interval, only the latest.
+    // Requires the proxy to route by symbol (-r).
+    bool subscribe(uint64_t id, const std::string& symbol, const char* subscription_request, uint32_t request_len, SubscriptionType type, bool& existing, uint32_t conflate_ms = 0);
     bool unsubscribe(uint64_t id, const std::string& symbol, const char* unsubscription_request, uint32_t request_len);
+    // Authenticates websocket id through the proxy, once per url and api key. The first client sends request
+    // upstream and waits for a frame containing success or failure, later clients get the cached reply without
+    // a round trip. The request is sent again whenever the proxy reconnects. response receives the reply if not null.
+    bool authenticate(uint64_t id, const char* request, uint32_t len, const std::string& success, const std::string& failure, std::string* response = nullptr);
     bool setLogLevel(LogLevel::level_enum level);
+    // Decode Alpaca JSON frames in place and deliver them through onQuote, onTrade, onBar and onStatus
+    // instead of onWebsocketData. Frames that aren't JSON arrays still go to onWebsocketData. Delivery is partial
+    // for a frame malformed after its first objects: those are delivered, the rest is dropped and reported
+    // through logError. Set before opening.
+    void decodeMarketData(bool enable) noexcept { decode_market_data_ = enable; }
+    // Whether the proxy decodes market data itself, started with -e. Quotes, trades and bars, including
+    // cached and conflated ones, then arrive through onQuote, onTrade and onBar only. Valid once connected.
+    bool binaryMarketData() const noexcept { return binary_market_data_.load(std::memory_order_relaxed); }
+    // Drop frames without any symbol this client subscribed to through subscribe() before the callbacks,
+    // e.g. on a proxy shared with other clients that doesn't route by symbol. Frames without a symbol, and
+    // websockets never subscribed through subscribe(), are not filtered. Once its last symbol is unsubscribed,
+    // a websocket stays filtered and its frames with symbols are dropped. Set before opening.
+    void filterSubscribedSymbols(bool enable) noexcept { filter_symbols_ = enable; }
+    // Also applies to the calling thread in openWebSocket, subscribe and the other requests waiting for the proxy.
+    // Set before opening.
+    void setWaitPolicy(WaitPolicy policy, uint32_t spin_us = 50) noexcept {
+        wait_policy_ = policy;
+        wait_spin_ns_ = uint64_t(spin_us) * 1000;
+    }
+    // Pins the worker thread to core, -1 doesn't pin, and runs it with real-time priority if realtime_priority > 0.
+    // Failures are logged as warnings. Set before opening.
+    void setWorkerThread(int core, int realtime_priority = 0) noexcept {
+        worker_core_ = core;
+        worker_priority_ = realtime_priority;
+    }
+    // No worker thread is started, the application consumes with poll() and the callbacks run on its thread.
+    // Set before opening.
+    void setManualPolling(bool enable) noexcept { manual_polling_ = enable; }
+    // Reads up to about max_messages from the queues and calls back inline. Also sends the heartbeats and detects
+    // a lost proxy, so call it at least every HEARTBEAT_INTERVAL. Returns the messages read. Only with
+    // setManualPolling, from one thread at a time.
+    uint32_t poll(uint32_t max_messages = 64);
     void send(uint64_t id, const char* msg, uint32_t len);
 
+    // Queries the proxy's latencies, see StatsMessage. reset clears the proxy's histograms afterwards.
+    bool requestStats(StatsMessage& stats, bool reset = false);
+
+    // Latencies of the data this client received, in ns. Reported to the proxy every STATS_INTERVAL.
+    const LatencyHistogram& queueResidency() const noexcept { return queue_residency_; }
+    const LatencyHistogram& callbackDuration() const noexcept { return callback_duration_; }
+    void resetLatencyStats() noexcept {
+        queue_residency_.reset();
+        callback_duration_.reset();
+    }
+
 private:
     bool connect();
     bool spawnWebsocketsProxyServer();
@@ -80,32 +154,95 @@ private:
     Message* sendOpenMessage(const std::string& url, const std::string &api_key);
     bool waitForResponse(Message* msg, uint32_t timeout = 10000);
     bool sendHeartbeat(uint64_t now);
+    bool sendStats(uint64_t now);
+    void fillStats(StatsMessage& stats);
     void doWork();
+    // one pass over the queues, returns the messages read. busy is false if there was nothing to do
+    uint32_t consume(uint64_t server_pid, bool& busy);
+    void waitForData(uint64_t& idle_since);
     void handleWsOpen(Message* msg);
     void handleWsClose(Message* msg);
     void handleWsError(Message* msg);
     void handleWsData(Message* msg);
+    void decodeWsData(WsData* data, const SymbolFilter* filter);
+    void decodeFrame(uint64_t id, const char* data, uint32_t len, uint64_t recv_time, const SymbolFilter* filter);
+    bool filterWsData(WsData* data, const SymbolFilter*& filter);
+    bool updateSubscribedSymbols(uint64_t id, const std::string& symbol, bool subscribed, bool* created = nullptr);
+    void rollbackSubscribedSymbol(uint64_t id, const std::string& symbol, bool created);
+    void applySymbolChanges();
+    template<typename T, typename Fn>
+    void handleMarketData(Message* msg, Fn&& fn);
+    void handleWsReconnect(Message* msg);
+    void checkStatus();
+    void handleOverrun(const OverrunMessage& overrun);
+    void handleServerMessage(Message* msg);
+    void handleServerDisconnected();
 
-    template<typename T>
-    std::tuple<Message*, uint64_t, uint32_t> reserveMessage(uint32_t data_size = 0);
-
-    std::tuple<Message*, uint64_t, uint32_t> reserveMessage();
+    template<typename T = void>
+    MessageSlot<T> reserveMessage(Message::Type type, uint32_t data_size = 0);
     
 private:
     WebsocketProxyCallback* callback_ = nullptr;
     std::unique_ptr<SHM_QUEUE_T> client_queue_;
+    std::unique_ptr<Notifier> client_notifier_;
+    // signalled by the proxy when it publishes, see WaitPolicy::Block
+    std::unique_ptr<Notifier> server_notifier_;
+    WaitPolicy wait_policy_ = WaitPolicy::Yield;
+    uint64_t wait_spin_ns_ = 50000;
     std::unique_ptr<SHM_QUEUE_T> server_queue_;
     uint64_t server_queue_index_ = 0;
+    std::unique_ptr<SHM_QUEUE_T> data_queue_;
+    uint64_t data_queue_index_ = 0;
+    // this client's entry in the proxy's client status segment, seq of the last notice seen
+    std::unique_ptr<SharedMemory> status_shm_;
+    const ClientStatus* status_ = nullptr;
+    uint64_t status_seq_ = 0;
     uint64_t last_heartbeat_time_ = 0;
     uint64_t last_server_heartbeat_time_ = 0;
+    uint64_t last_stats_time_ = 0;
+    // mirrors of the worker thread's read positions for the heartbeat, which may be sent from other threads
+    std::atomic<uint64_t> server_queue_cursor_{ 0 };
+    std::atomic<uint64_t> data_queue_cursor_{ 0 };
+    std::atomic<uint64_t> messages_consumed_{ 0 };
+    uint64_t last_stats_count_ = 0;
+    // proxy publish to read by this client, and onWebsocketData duration
+    LatencyHistogram queue_residency_;
+    LatencyHistogram callback_duration_;
     uint64_t id_ = 0;
     const uint64_t pid_;
     std::atomic<uint64_t> server_pid_ = 0;
     std::shared_ptr<std::atomic_bool> run_;
     std::string name_;
     std::filesystem::path exe_path_;
+    std::string proxy_args_;
     std::unordered_set<uint64_t> websockets_;
+    bool decode_market_data_ = false;
+    std::atomic_bool binary_market_data_{ false };
+    // chunks of large messages per websocket until the last one arrives, when decoding market data
+    std::unordered_map<uint64_t, std::string> partial_frames_;
+    bool filter_symbols_ = false;
+    // symbols subscribed per websocket, updated by the threads calling subscribe and unsubscribe
+    std::mutex symbols_mutex_;
+    std::unordered_map<uint64_t, std::unordered_set<std::string>> subscribed_symbols_;
+    std::atomic<uint64_t> symbols_version_{ 0 };
+    struct SymbolChange {
+        enum class Op : uint8_t { Insert, Erase, Clear };
+        uint64_t id;
+        std::string symbol;
+        Op op;
+    };
+    // changes to subscribed_symbols_ not yet applied to symbol_filters_
+    std::vector<SymbolChange> symbol_changes_;
+    std::vector<SymbolChange> applying_symbol_changes_;
+    // the worker thread's filters, updated with symbol_changes_ when symbols_version_ changes
+    std::unordered_map<uint64_t, SymbolFilter> symbol_filters_;
+    uint64_t filters_version_ = 0;
+    // websockets in the middle of a chunked message, whose remaining chunks are never filtered
+    std::unordered_set<uint64_t> chunked_;
     std::unique_ptr<std::thread> worker_thread_;
+    int worker_core_ = -1;
+    int worker_priority_ = 0;
+    bool manual_polling_ = false;
 };
 
 
@@ -116,47 +253,14 @@ inline uint64_t get_timestamp() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
 }
 
-template<typename T>
-inline uint32_t get_message_size(uint32_t data_len = 0) {
-    return sizeof(Message) + sizeof(T) + data_len * sizeof(char);
-}
-
-inline bool isProcessRunning(const wchar_t* name) {
-    bool exists = false;
-    PROCESSENTRY32 entry;
-    entry.dwSize = sizeof(PROCESSENTRY32);
-    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, NULL);
-    if (Process32First(snapshot, &entry)) {
-        while (Process32Next(snapshot, &entry)) {
-            if (!_wcsicmp(entry.szExeFile, name)) {
-                exists = true;
-                break;
-            }
-        }
-    }
-    CloseHandle(snapshot);
-    return exists;
-}
-
-inline bool isProcessRunning(uint64_t processID) {
-    if (HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, (DWORD)processID)) {
-        DWORD exitCodeOut;
-        // GetExitCodeProcess returns zero on failure
-        if (GetExitCodeProcess(process, &exitCodeOut)) {
-            return exitCodeOut == STILL_ACTIVE;
-        }
-    }
-    return false;
-}
-
-
 ////////////////////////////// WebsocketProxyClient Implementation //////////////////////////////
 
-inline WebsocketProxyClient::WebsocketProxyClient(WebsocketProxyCallback* callback, std::string&& name, std::string&& proxy_exe_path)
+inline WebsocketProxyClient::WebsocketProxyClient(WebsocketProxyCallback* callback, std::string&& name, std::string&& proxy_exe_path, std::string&& proxy_args)
     : callback_(callback)
-    , pid_(GetCurrentProcessId())
+    , pid_(getCurrentProcessId())
     , name_(std::move(name))
     , exe_path_(std::move(proxy_exe_path))
+    , proxy_args_(std::move(proxy_args))
 {
     if (!std::filesystem::exists(exe_path_))
     {
@@ -184,7 +288,7 @@ inline WebsocketProxyClient::~WebsocketProxyClient()
 }
 
 inline bool WebsocketProxyClient::connect() {
-    if (!worker_thread_) {
+    if (!worker_thread_ && !manual_polling_) {
         worker_thread_ = std::make_unique<std::thread>([this]() { doWork(); });
     }
 
@@ -203,8 +307,10 @@ inline bool WebsocketProxyClient::connect() {
 
 inline void WebsocketProxyClient::sendMessage(Message* msg, uint64_t index, uint32_t size) {
     msg->status.store(Message::Status::PENDING, std::memory_order_relaxed);
-    client_queue_->publish(index, size);
-    last_heartbeat_time_ = get_timestamp();
+    publishMessage(*client_queue_, msg, index, size);
+    if (client_notifier_) {
+        client_notifier_->notify();
+    }
 }
 
 inline bool WebsocketProxyClient::waitForResponse(Message* msg, uint32_t timeout) {
@@ -214,7 +320,14 @@ inline bool WebsocketProxyClient::waitForResponse(Message* msg, uint32_t timeout
         if ((now - start) > timeout) {
             return false;
         }
-        if (!sendHeartbeat(now)) {
+        if (sendHeartbeat(now)) {
+            continue;
+        }
+        if (wait_policy_ == WaitPolicy::Block && server_notifier_) {
+            // the proxy notifies once it answered, the timeout keeps the heartbeats going
+            server_notifier_->wait([msg]() { return msg->status.load(std::memory_order_relaxed) != Message::Status::PENDING; }, 10);
+        }
+        else {
             std::this_thread::yield();
         }
     }
@@ -222,24 +335,17 @@ inline bool WebsocketProxyClient::waitForResponse(Message* msg, uint32_t timeout
 }
 
 inline bool WebsocketProxyClient::spawnWebsocketsProxyServer() {
-    if (!isProcessRunning(L"websocket_proxy.exe")) {
-        STARTUPINFOW si;
-        PROCESS_INFORMATION pi;
-        ZeroMemory(&si, sizeof(si));
-        si.cb = sizeof(si);
-        ZeroMemory(&pi, sizeof(pi));
-
+    if (!isProcessRunning(WEBSOCKET_PROXY_PROCESS_NAME)) {
         callback_->logInfo([]() { return "Spawn websocket_proxy"; });
-        if (!CreateProcessW(exe_path_.c_str(), NULL, NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &si, &pi)) {
-            callback_->logError([](){ return std::format("Failed to launch websocket_proxy. err={}", GetLastError()); });
+        std::string err;
+        if (!spawnProcess(exe_path_, proxy_args_, err)) {
+            callback_->logError([&err](){ return std::format("Failed to launch websocket_proxy. {}", err); });
             return false;
         }
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
 
         // wait for proxy to start up
         auto start = get_timestamp();
-        while (!isProcessRunning(L"websocket_proxy.exe") && (get_timestamp() - start) < 10000) {
+        while (!isProcessRunning(WEBSOCKET_PROXY_PROCESS_NAME) && (get_timestamp() - start) < 10000) {
             std::this_thread::yield();
         }
         callback_->logInfo([]() { return "websocket_proxy started"; });
@@ -271,7 +377,27 @@ inline bool WebsocketProxyClient::spawnWebsocketsProxyServer() {
         return false;
     }
 
+    try {
+        client_notifier_ = std::make_unique<Notifier>(CLIENT_TO_SERVER_NOTIFIER, false);
+    }
+    catch (const std::runtime_error& e) {
+        // the server polls the queue if it doesn't wait on the notifier
+        callback_->logWarning([&e]() { return e.what(); });
+    }
+
+    if (wait_policy_ == WaitPolicy::Block) {
+        try {
+            server_notifier_ = std::make_unique<Notifier>(SERVER_TO_CLIENT_NOTIFIER, false);
+            server_notifier_->registerWaiter();
+        }
+        catch (const std::runtime_error& e) {
+            // e.g. an older proxy, the worker yields instead
+            callback_->logWarning([&e]() { return e.what(); });
+        }
+    }
+
     server_queue_index_ = server_queue_->initial_reading_index();
+    server_queue_cursor_.store(server_queue_index_, std::memory_order_relaxed);
     return true;
 }
 
@@ -288,11 +414,9 @@ inline bool WebsocketProxyClient::waitForServerReady()
 }
 
 inline bool WebsocketProxyClient::_register() {
-    auto [msg, index, size] = reserveMessage<RegisterMessage>();
-    msg->type = Message::Type::Register;
-    auto reg = reinterpret_cast<RegisterMessage*>(msg->data);
-    strcpy_s(reg->name, 31, name_.c_str());
-    reg->name[31] = 0;
+    auto [msg, reg, index, size] = reserveMessage<RegisterMessage>(Message::Type::Register);
+    strncpy(reg->name, name_.c_str(), sizeof(reg->name) - 1);
+    reg->name[sizeof(reg->name) - 1] = 0;
     sendMessage(msg, index, size);
     if (!waitForResponse(msg, 20000)) {
         callback_->logError([]() { return "Unable to connect to websocket_proxy. timeout"; });
@@ -304,14 +428,40 @@ inline bool WebsocketProxyClient::_register() {
         callback_->logError([reg]() { return reg->err; });
         return false;
     }
+    if (reg->data_queue[0]) {
+        // server routes symbol data to this client only
+        try {
+            data_queue_ = std::make_unique<SHM_QUEUE_T>(reg->data_queue);
+            data_queue_index_ = data_queue_->initial_reading_index();
+            data_queue_cursor_.store(data_queue_index_, std::memory_order_relaxed);
+        }
+        catch (const std::runtime_error& e) {
+            callback_->logError([&e]() { return std::format("Failed to open data queue. err={}", e.what()); });
+            return false;
+        }
+    }
+    else {
+        data_queue_.reset();
+    }
+    binary_market_data_.store(reg->binary_market_data, std::memory_order_relaxed);
+    status_ = nullptr;
+    try {
+        status_shm_ = std::make_unique<SharedMemory>(CLIENT_STATUS_SEGMENT, sizeof(ClientStatus) * kMaxClients, false);
+        status_ = static_cast<const ClientStatus*>(status_shm_->data()) + reg->slot;
+        // notices for an earlier client in the slot
+        status_seq_ = status_->seq.load(std::memory_order_acquire) & ~uint64_t(1);
+    }
+    catch (const std::runtime_error& e) {
+        // e.g. an older proxy, overruns are not reported
+        callback_->logWarning([&e]() { return e.what(); });
+    }
     server_pid_.store(reg->server_pid, std::memory_order_release);
     callback_->logInfo([reg]() { return std::format("Proxy server connected, pid={}", reg->server_pid); });
     return true;
 }
 
 inline void WebsocketProxyClient::unregister() {
-    auto [msg, index, size] = reserveMessage();
-    msg->type = Message::Type::Unregister;
+    auto [msg, body, index, size] = reserveMessage(Message::Type::Unregister);
     sendMessage(msg, index, size);
     server_pid_.store(0, std::memory_order_release);
     callback_->logInfo([this]() { return std::format("Unregistered, pid={}", pid_); });
@@ -355,20 +505,16 @@ inline Message* WebsocketProxyClient::sendOpenMessage(const std::string& url, co
         }
     }
 
-    auto [msg, index, size] = reserveMessage<WsOpen>();
-    msg->type = Message::Type::OpenWs;
-    auto req = reinterpret_cast<WsOpen*>(msg->data);
-    strcpy_s(req->url, 512, url.c_str());
-    strcpy_s(req->api_key, 512, api_key.c_str());
+    auto [msg, req, index, size] = reserveMessage<WsOpen>(Message::Type::OpenWs);
+    strncpy(req->url, url.c_str(), sizeof(req->url) - 1);
+    strncpy(req->api_key, api_key.c_str(), sizeof(req->api_key) - 1);
     
     sendMessage(msg, index, size);
     return msg;
 }
 
 inline bool WebsocketProxyClient::closeWebSocket(uint64_t id) {
-    auto [msg, index, size] = reserveMessage<WsClose>();
-    msg->type = Message::Type::CloseWs;
-    auto req = reinterpret_cast<WsClose*>(msg->data);
+    auto [msg, req, index, size] = reserveMessage<WsClose>(Message::Type::CloseWs);
     req->id = !id ? id_ : id;
     // log_(L_INFO, "Close ws " + std::to_string(req->id));
     sendMessage(msg, index, size);
@@ -380,122 +526,371 @@ inline bool WebsocketProxyClient::closeWebSocket(uint64_t id) {
     return true;
 }
 
-inline bool WebsocketProxyClient::subscribe(uint64_t id, const std::string& symbol, const char* subscription_request, uint32_t request_len, SubscriptionType type, bool& existing) {
-    auto [msg, index, size] = reserveMessage<WsSubscription>(request_len);
-    msg->type = Message::Type::Subscribe;
-    auto req = reinterpret_cast<WsSubscription*>(msg->data);
+inline bool WebsocketProxyClient::subscribe(uint64_t id, const std::string& symbol, const char* subscription_request, uint32_t request_len, SubscriptionType type, bool& existing, uint32_t conflate_ms) {
+    auto [msg, req, index, size] = reserveMessage<WsSubscription>(Message::Type::Subscribe, request_len);
     req->request_len = request_len;
     req->id = id;
     req->type = type;
+    req->conflate_ms = conflate_ms;
     memcpy(&req->symbol[0], symbol.c_str(), symbol.size());
     memcpy(req->request, subscription_request, request_len);
+    // before the request goes out, so the first data isn't filtered
+    bool created = false;
+    bool added = filter_symbols_ && updateSubscribedSymbols(id, symbol, true, &created);
     sendMessage(msg, index, size);
     if (!waitForResponse(msg)) {
         callback_->logError([&symbol]() { return std::format("Subscribe {} timeout", symbol); });
+        if (added) {
+            rollbackSubscribedSymbol(id, symbol, created);
+        }
+        return false;
+    }
+    if (msg->status.load(std::memory_order_relaxed) == Message::Status::FAILED) {
+        callback_->logError([&symbol]() { return std::format("Subscribe {} failed", symbol); });
+        if (added) {
+            rollbackSubscribedSymbol(id, symbol, created);
+        }
         return false;
     }
     return true;
 }
 
 inline bool WebsocketProxyClient::unsubscribe(uint64_t id, const std::string& symbol, const char* unsubscription_request, uint32_t request_len) {
-    auto [msg, index, size] = reserveMessage<WsSubscription>(request_len);
-    msg->type = Message::Type::Unsubscribe;
-    auto req = reinterpret_cast<WsSubscription*>(msg->data);
+    auto [msg, req, index, size] = reserveMessage<WsSubscription>(Message::Type::Unsubscribe, request_len);
     req->request_len = request_len;
     req->id = id;
     req->existing = false;
     memcpy(&req->symbol[0], symbol.c_str(), symbol.size());
     memcpy(req->request, unsubscription_request, request_len);
+    if (filter_symbols_) {
+        updateSubscribedSymbols(id, symbol, false);
+    }
     sendMessage(msg, index, size);
     return true;
 }
 
+// Returns false if the symbols didn't change. created is set if the websocket wasn't filtered before.
+inline bool WebsocketProxyClient::updateSubscribedSymbols(uint64_t id, const std::string& symbol, bool subscribed, bool* created) {
+    std::lock_guard lock(symbols_mutex_);
+    if (subscribed) {
+        auto [it, inserted] = subscribed_symbols_.try_emplace(id);
+        if (created) {
+            *created = inserted;
+        }
+        if (!it->second.insert(symbol).second) {
+            return false;
+        }
+        symbol_changes_.push_back({ id, symbol, SymbolChange::Op::Insert });
+    }
+    else {
+        // not filtered if never subscribed through subscribe(), e.g. with send(). Otherwise the websocket
+        // stays filtered with its remaining symbols, none once the last is removed.
+        auto it = subscribed_symbols_.find(id);
+        if (it == subscribed_symbols_.end() || !it->second.erase(symbol)) {
+            return false;
+        }
+        symbol_changes_.push_back({ id, symbol, SymbolChange::Op::Erase });
+    }
+    symbols_version_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+// Undoes a subscribe that failed. A websocket the subscribe started filtering is no longer filtered if it has no
+// other symbols.
+inline void WebsocketProxyClient::rollbackSubscribedSymbol(uint64_t id, const std::string& symbol, bool created) {
+    std::lock_guard lock(symbols_mutex_);
+    auto it = subscribed_symbols_.find(id);
+    if (it == subscribed_symbols_.end() || !it->second.erase(symbol)) {
+        return;
+    }
+    if (created && it->second.empty()) {
+        subscribed_symbols_.erase(it);
+        symbol_changes_.push_back({ id, {}, SymbolChange::Op::Clear });
+    }
+    else {
+        symbol_changes_.push_back({ id, symbol, SymbolChange::Op::Erase });
+    }
+    symbols_version_.fetch_add(1, std::memory_order_release);
+}
+
+// Applies the changes since the last call to the worker thread's filters, without rebuilding them
+inline void WebsocketProxyClient::applySymbolChanges() {
+    {
+        std::lock_guard lock(symbols_mutex_);
+        applying_symbol_changes_.swap(symbol_changes_);
+        filters_version_ = symbols_version_.load(std::memory_order_relaxed);
+    }
+    for (auto& change : applying_symbol_changes_) {
+        switch (change.op) {
+        case SymbolChange::Op::Insert:
+            symbol_filters_[change.id].insert(change.symbol);
+            break;
+        case SymbolChange::Op::Erase:
+            symbol_filters_[change.id].erase(change.symbol);
+            break;
+        case SymbolChange::Op::Clear:
+            symbol_filters_.erase(change.id);
+            break;
+        }
+    }
+    applying_symbol_changes_.clear();
+}
+
+inline bool WebsocketProxyClient::authenticate(uint64_t id, const char* request, uint32_t len, const std::string& success, const std::string& failure, std::string* response) {
+    if (success.size() >= sizeof(WsAuth::success) || failure.size() >= sizeof(WsAuth::failure)) {
+        callback_->logError([]() { return "Authentication markers are too long. limit is 63 characters"; });
+        return false;
+    }
+    auto [msg, req, index, size] = reserveMessage<WsAuth>(Message::Type::Auth, len);
+    req->id = id;
+    memcpy(req->success, success.c_str(), success.size());
+    memcpy(req->failure, failure.c_str(), failure.size());
+    req->request_len = len;
+    memcpy(req->request, request, len);
+    sendMessage(msg, index, size);
+    // the proxy gives up on the upstream reply after AUTH_TIMEOUT
+    if (!waitForResponse(msg, AUTH_TIMEOUT + HEARTBEAT_INTERVAL)) {
+        callback_->logError([id]() { return std::format("Authenticate ws {} timeout", id); });
+        return false;
+    }
+    if (response) {
+        response->assign(req->response, req->response_len);
+    }
+    return msg->status.load(std::memory_order_relaxed) == Message::Status::SUCCESS;
+}
+
 inline bool WebsocketProxyClient::setLogLevel(LogLevel::level_enum level) {
-    auto [msg, index, size] = reserveMessage<LogLevel>();
-    msg->type = Message::Type::LogLevel;
-    auto req = reinterpret_cast<LogLevel*>(msg->data);
+    auto [msg, req, index, size] = reserveMessage<LogLevel>(Message::Type::LogLevel);
     req->level = level;
     sendMessage(msg, index, size);
     return true;
 }
 
 inline void WebsocketProxyClient::send(uint64_t id, const char* data, uint32_t len) {
-    auto [msg, index, size] = reserveMessage<WsRequest>(len);
-    msg->type = Message::Type::WsRequest;
-    auto req = reinterpret_cast<WsRequest*>(msg->data);
+    auto [msg, req, index, size] = reserveMessage<WsRequest>(Message::Type::WsRequest, len);
     req->len = len;
     req->id = id;
     memcpy(req->data, data, len);
     sendMessage(msg, index, size);
 }
 
+inline bool WebsocketProxyClient::requestStats(StatsMessage& stats, bool reset) {
+    if (!server_pid_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto [msg, req, index, size] = reserveMessage<StatsMessage>(Message::Type::Stats);
+    fillStats(*req);
+    req->reply = true;
+    req->reset = reset;
+    sendMessage(msg, index, size);
+    if (!waitForResponse(msg) || msg->status.load(std::memory_order_relaxed) != Message::Status::SUCCESS) {
+        callback_->logError([]() { return "Stats request failed"; });
+        return false;
+    }
+    memcpy(&stats, req, sizeof(StatsMessage));
+    return true;
+}
+
+inline void WebsocketProxyClient::fillStats(StatsMessage& stats) {
+    stats.queue_residency = queue_residency_.stats();
+    stats.callback = callback_duration_.stats();
+}
+
 inline void WebsocketProxyClient::doWork() {
     run_ = std::make_shared<std::atomic_bool>(true);
     std::shared_ptr<std::atomic_bool> run = run_;
+    if (worker_core_ >= 0 && !setThreadAffinity(static_cast<uint32_t>(worker_core_))) {
+        callback_->logWarning([this]() { return std::format("Failed to pin the worker thread to core {}", worker_core_); });
+    }
+    if (worker_priority_ > 0 && !setThreadRealtimePriority(worker_priority_)) {
+        callback_->logWarning([this]() { return std::format("Failed to set real-time priority {} on the worker thread", worker_priority_); });
+    }
+
+    uint64_t idle_since = 0;
     while (run->load(std::memory_order_relaxed)) {
-        auto server_pid = server_pid_.load(std::memory_order_relaxed);
+        auto server_pid = server_pid_.load(std::memory_order_acquire);
         if (!server_pid) {
             // not connected yet
             std::this_thread::sleep_for(std::chrono::milliseconds(250));
             continue;
         }
-        auto now = get_timestamp();
-        auto result = server_queue_->read(server_queue_index_);
-        if (result.first) {
-            auto msg = reinterpret_cast<Message*>(result.first);
-            //log_(L_DEBUG, std::to_string(msg->type));
-            last_server_heartbeat_time_ = now;
-            if (server_pid != msg->pid) {
-                continue;
-            }
-            switch (msg->type) {
-            case Message::Type::OpenWs:
-                handleWsOpen(msg);
-                break;
-            case Message::Type::CloseWs:
-                handleWsClose(msg);
-                break;
-            case Message::Type::WsError:
-                handleWsError(msg);
-                break;
-            case Message::Type::WsData:
-                handleWsData(msg);
-                break;
-            }
+        bool busy = false;
+        if (consume(server_pid, busy)) {
+            idle_since = 0;
+        }
+        if (!busy) {
+            waitForData(idle_since);
         }
+    }
+    callback_->logDebug([]() { return "WebsocketProxyClient work thread exit"; });
+}
 
-        bool heartbeat_sent = sendHeartbeat(now);
+inline uint32_t WebsocketProxyClient::poll(uint32_t max_messages) {
+    auto server_pid = server_pid_.load(std::memory_order_acquire);
+    if (!server_pid) {
+        return 0;
+    }
+    uint32_t n = 0;
+    uint32_t read;
+    bool busy;
+    do {
+        read = consume(server_pid, busy);
+        n += read;
+    } while (read && n < max_messages);
+    return n;
+}
 
-        if (!result.first) {
-            if (last_server_heartbeat_time_ && (now - last_server_heartbeat_time_) > HEARTBEAT_TIMEOUT) {
-                callback_->logInfo([this, now, server_pid]() { return std::format("Server {}  heatbeat timeout. now={}, last_seen={}", server_pid, now, last_server_heartbeat_time_); });
-                server_pid_.store(0, std::memory_order_release);
-                callback_->onWebsocketProxyServerDisconnected();
-                if (!websockets_.empty()) {
-                    for (auto& id : websockets_) {
-                        callback_->onWebsocketClosed(id);
-                    }
-                    websockets_.clear();
-                }
-            }
-            else if (!heartbeat_sent) {
-                std::this_thread::yield();
-            }
+inline uint32_t WebsocketProxyClient::consume(uint64_t server_pid, bool& busy) {
+    auto now = get_timestamp();
+    uint32_t n = 0;
+    checkStatus();
+    if (!server_pid_.load(std::memory_order_relaxed)) {
+        // unregistered by the proxy
+        busy = true;
+        return 0;
+    }
+    auto result = server_queue_->read(server_queue_index_);
+    if (result.first) {
+        ++n;
+        auto msg = reinterpret_cast<Message*>(result.first);
+        last_server_heartbeat_time_ = now;
+        server_queue_cursor_.store(server_queue_index_, std::memory_order_relaxed);
+        // skips messages of another server instance
+        if (server_pid == msg->pid) {
+            handleServerMessage(msg);
+            messages_consumed_.store(messages_consumed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
         }
     }
-    callback_->logDebug([]() { return "WebsocketProxyClient work thread exit"; });
+
+    if (data_queue_) {
+        auto data = data_queue_->read(data_queue_index_);
+        if (data.first) {
+            ++n;
+            data_queue_cursor_.store(data_queue_index_, std::memory_order_relaxed);
+            handleServerMessage(reinterpret_cast<Message*>(data.first));
+            messages_consumed_.store(messages_consumed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    busy = (sendHeartbeat(now) | sendStats(now)) || n;
+    if (!result.first && last_server_heartbeat_time_ && (now - last_server_heartbeat_time_) > HEARTBEAT_TIMEOUT) {
+        callback_->logInfo([this, now, server_pid]() { return std::format("Server {}  heatbeat timeout. now={}, last_seen={}", server_pid, now, last_server_heartbeat_time_); });
+        handleServerDisconnected();
+        busy = true;
+    }
+    return n;
+}
+
+inline void WebsocketProxyClient::waitForData(uint64_t& idle_since) {
+    switch (wait_policy_) {
+    case WaitPolicy::BusySpin:
+        cpu_relax();
+        return;
+    case WaitPolicy::Yield:
+        std::this_thread::yield();
+        return;
+    case WaitPolicy::Block:
+        break;
+    }
+
+    if (!server_notifier_) {
+        std::this_thread::yield();
+        return;
+    }
+    auto now = get_monotonic_ns();
+    if (!idle_since) {
+        idle_since = now;
+    }
+    if (now - idle_since < wait_spin_ns_) {
+        cpu_relax();
+        return;
+    }
+
+    // wakes up for the next heartbeat at the latest
+    auto since_heartbeat = get_timestamp() - last_heartbeat_time_;
+    auto timeout = since_heartbeat < HEARTBEAT_INTERVAL ? HEARTBEAT_INTERVAL - since_heartbeat : 1;
+    server_notifier_->wait([this]() {
+        auto index = server_queue_index_;
+        if (server_queue_->read(index).first) {
+            return true;
+        }
+        index = data_queue_index_;
+        return data_queue_ && data_queue_->read(index).first != nullptr;
+    }, static_cast<uint32_t>(timeout));
+}
+
+inline void WebsocketProxyClient::handleServerMessage(Message* msg) {
+    switch (msg->type) {
+    case Message::Type::OpenWs:
+        handleWsOpen(msg);
+        break;
+    case Message::Type::CloseWs:
+        handleWsClose(msg);
+        break;
+    case Message::Type::WsError:
+        handleWsError(msg);
+        break;
+    case Message::Type::WsData:
+        handleWsData(msg);
+        break;
+    case Message::Type::Quote:
+        handleMarketData<QuoteMessage>(msg, [this](const QuoteMessage& quote) { callback_->onQuote(quote); });
+        break;
+    case Message::Type::Trade:
+        handleMarketData<TradeMessage>(msg, [this](const TradeMessage& trade) { callback_->onTrade(trade); });
+        break;
+    case Message::Type::Bar:
+        handleMarketData<BarMessage>(msg, [this](const BarMessage& bar) { callback_->onBar(bar); });
+        break;
+    case Message::Type::ReconnectWs:
+        handleWsReconnect(msg);
+        break;
+    }
+}
+
+inline void WebsocketProxyClient::handleServerDisconnected() {
+    server_pid_.store(0, std::memory_order_release);
+    callback_->onWebsocketProxyServerDisconnected();
+    if (!websockets_.empty()) {
+        for (auto& id : websockets_) {
+            callback_->onWebsocketClosed(id);
+        }
+        websockets_.clear();
+        partial_frames_.clear();
+        chunked_.clear();
+    }
 }
 
 inline bool WebsocketProxyClient::sendHeartbeat(uint64_t now) {
+    // sent every interval regardless of other requests, the proxy tracks this client's lag from the cursors
     if (server_pid_.load(std::memory_order_relaxed) && (now - last_heartbeat_time_) > HEARTBEAT_INTERVAL) {
-        auto [msg, index, size] = reserveMessage();
-        msg->type = Message::Type::Heartbeat;
+        last_heartbeat_time_ = now;
+        auto [msg, heartbeat, index, size] = reserveMessage<HeartbeatMessage>(Message::Type::Heartbeat);
+        heartbeat->server_queue_cursor = server_queue_cursor_.load(std::memory_order_relaxed);
+        heartbeat->data_queue_cursor = data_queue_cursor_.load(std::memory_order_relaxed);
+        heartbeat->messages_consumed = messages_consumed_.load(std::memory_order_relaxed);
         sendMessage(msg, index, size);
         return true;
     }
     return false;
 }
 
+inline bool WebsocketProxyClient::sendStats(uint64_t now) {
+    // only when new data arrived since the last report
+    auto count = callback_duration_.count();
+    if (count == last_stats_count_ || (now - last_stats_time_) < STATS_INTERVAL || !server_pid_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    last_stats_time_ = now;
+    last_stats_count_ = count;
+    auto [msg, req, index, size] = reserveMessage<StatsMessage>(Message::Type::Stats);
+    fillStats(*req);
+    req->reply = false;
+    req->reset = false;
+    sendMessage(msg, index, size);
+    return true;
+}
+
 inline void WebsocketProxyClient::handleWsOpen(Message* msg) {
     auto open = reinterpret_cast<WsOpen*>(msg->data);
     callback_->logDebug([open]() { return std::format("handleWsOPen, initiator={}", open->client_pid); });
@@ -510,6 +905,15 @@ inline void WebsocketProxyClient::handleWsClose(Message* msg) {
     auto it = websockets_.find(close->id);
     if (it != websockets_.end()) {
         websockets_.erase(close->id);
+        partial_frames_.erase(close->id);
+        chunked_.erase(close->id);
+        if (filter_symbols_) {
+            std::lock_guard lock(symbols_mutex_);
+            if (subscribed_symbols_.erase(close->id)) {
+                symbol_changes_.push_back({ close->id, {}, SymbolChange::Op::Clear });
+                symbols_version_.fetch_add(1, std::memory_order_release);
+            }
+        }
         callback_->onWebsocketClosed(close->id);
     }
     else {
@@ -536,7 +940,19 @@ inline void WebsocketProxyClient::handleWsData(Message* msg) {
     auto data = reinterpret_cast<WsData*>(msg->data);
     auto it = websockets_.find(data->id);
     if (it != websockets_.end()) {
-        callback_->onWebsocketData(data->id, data->data, data->len, data->remaining);
+        auto now = get_monotonic_ns();
+        queue_residency_.record(now - msg->timestamp);
+        const SymbolFilter* filter = nullptr;
+        if (filter_symbols_ && !filterWsData(data, filter)) {
+            return;
+        }
+        if (decode_market_data_) {
+            decodeWsData(data, filter);
+        }
+        else {
+            callback_->onWebsocketData(data->id, data->data, data->len, data->remaining);
+        }
+        callback_duration_.record(get_monotonic_ns() - now);
     }
     else {
         callback_->logDebug([data]() { return std::format("Ws data. socket not found. id={}", data->id); });
@@ -544,23 +960,133 @@ inline void WebsocketProxyClient::handleWsData(Message* msg) {
     }
 }
 
+inline bool WebsocketProxyClient::filterWsData(WsData* data, const SymbolFilter*& filter) {
+    // a chunk can't be filtered on its own
+    if (data->remaining) {
+        chunked_.insert(data->id);
+        return true;
+    }
+    if (!chunked_.empty() && chunked_.erase(data->id)) {
+        return true;
+    }
+
+    if (symbols_version_.load(std::memory_order_acquire) != filters_version_) {
+        applySymbolChanges();
+    }
+    auto it = symbol_filters_.find(data->id);
+    if (it == symbol_filters_.end()) {
+        return true;
+    }
+    filter = &it->second;
+    return filter->passes(data->data, data->len);
+}
+
+inline void WebsocketProxyClient::decodeWsData(WsData* data, const SymbolFilter* filter) {
+    auto partial = partial_frames_.find(data->id);
+    if (data->remaining == 0 && partial == partial_frames_.end()) {
+        decodeFrame(data->id, data->data, data->len, data->recv_time, filter);
+        return;
+    }
+
+    // chunks are only decoded once the message is complete
+    if (partial == partial_frames_.end()) {
+        partial = partial_frames_.emplace(data->id, std::string()).first;
+    }
+    partial->second.append(data->data, data->len);
+    if (data->remaining == 0) {
+        decodeFrame(data->id, partial->second.data(), static_cast<uint32_t>(partial->second.size()), data->recv_time, nullptr);
+        partial_frames_.erase(partial);
+    }
+}
+
+inline void WebsocketProxyClient::decodeFrame(uint64_t id, const char* data, uint32_t len, uint64_t recv_time, const SymbolFilter* filter) {
+    MarketData record;
+    Message::Type type;
+    uint32_t objects = 0;
+    auto ok = json::forEachObject(data, len, [&](const char* obj, size_t n) {
+        ++objects;
+        if (!market_data::decode(obj, n, id, recv_time, type, record)) {
+            callback_->onStatus(id, obj, static_cast<uint32_t>(n));
+        }
+        else if (filter && !filter->contains(record.quote.symbol)) {
+            // another symbol of a frame that passed the filter, symbol leads every record alike
+        }
+        else if (type == Message::Type::Quote) {
+            callback_->onQuote(record.quote);
+        }
+        else if (type == Message::Type::Trade) {
+            callback_->onTrade(record.trade);
+        }
+        else {
+            callback_->onBar(record.bar);
+        }
+    });
+    if (!ok && objects == 0) {
+        callback_->onWebsocketData(id, data, len, 0);
+    }
+    else if (!ok) {
+        // the objects before the malformed one were delivered, the rest of the frame is lost
+        callback_->logError([id, objects, len]() {
+            return std::format("Malformed frame on ws {}, delivered {} objects, dropped the rest of {} bytes", id, objects, len);
+        });
+    }
+}
+
+template<typename T, typename Fn>
+inline void WebsocketProxyClient::handleMarketData(Message* msg, Fn&& fn) {
+    auto record = reinterpret_cast<const T*>(msg->data);
+    if (websockets_.find(record->id) != websockets_.end()) {
+        auto now = get_monotonic_ns();
+        queue_residency_.record(now - msg->timestamp);
+        fn(*record);
+        callback_duration_.record(get_monotonic_ns() - now);
+    }
+}
+
+inline void WebsocketProxyClient::handleWsReconnect(Message* msg) {
+    auto reconnect = reinterpret_cast<WsReconnect*>(msg->data);
+    if (websockets_.find(reconnect->id) != websockets_.end()) {
+        callback_->logInfo([reconnect]() { return std::format("Ws {} {}", reconnect->id, reconnect->connected ? "reconnected" : "reconnecting"); });
+        callback_->onWebsocketReconnect(reconnect->id, reconnect->connected);
+    }
+}
+
+inline void WebsocketProxyClient::checkStatus() {
+    // one load per call unless the proxy wrote a new notice
+    if (!status_) {
+        return;
+    }
+    auto seq = status_->seq.load(std::memory_order_acquire);
+    if (seq == status_seq_ || (seq & 1)) {
+        return;
+    }
+    OverrunMessage overrun;
+    memcpy(&overrun, &status_->overrun, sizeof(overrun));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (status_->seq.load(std::memory_order_relaxed) != seq) {
+        // rewritten meanwhile, read again next time
+        return;
+    }
+    status_seq_ = seq;
+    if (overrun.client_pid == pid_) {
+        handleOverrun(overrun);
+    }
+}
+
+inline void WebsocketProxyClient::handleOverrun(const OverrunMessage& overrun) {
+    callback_->logWarning([&overrun]() {
+        return std::format("{} queue overrun. lag={} queue_size={} disconnected={}",
+            overrun.data_queue ? "Data" : "Server", overrun.lag, overrun.queue_size, overrun.disconnected);
+    });
+    callback_->onWebsocketProxyOverrun(overrun.lag, overrun.queue_size, overrun.disconnected);
+    if (overrun.disconnected) {
+        handleServerDisconnected();
+    }
+}
+
 template<typename T>
-inline std::tuple<Message*, uint64_t, uint32_t> WebsocketProxyClient::reserveMessage(uint32_t data_size) {
-    auto size = get_message_size<T>(data_size);
-    auto index = client_queue_->reserve(size);
-    auto msg = reinterpret_cast<Message*>((*(client_queue_.get()))[index]);
-    memset(msg, 0, size);
-    msg->pid = pid_;
-    return std::make_tuple(msg, index, size);
-}
-
-inline std::tuple<Message*, uint64_t, uint32_t> WebsocketProxyClient::reserveMessage() {
-    uint32_t size = sizeof(Message);
-    auto index = client_queue_->reserve(size);
-    auto msg = reinterpret_cast<Message*>((*(client_queue_.get()))[index]);
-    memset(msg, 0, size);
-    msg->pid = pid_;
-    return std::make_tuple(msg, index, size);
+inline MessageSlot<T> WebsocketProxyClient::reserveMessage(Message::Type type, uint32_t data_size) {
+    return reserveMessageSlot<T>(*client_queue_, pid_, type, data_size);
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <websocket_proxy/json_scanner.h>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace websocket_proxy {
+
+// A message split out of an upstream frame. It points into the frame buffer.
+struct FramePart {
+    const char* data;
+    uint32_t len;
+    std::string_view symbol;
+};
+
+// Splits batched upstream frames into individual messages so they can be routed separately.
+class FrameSplitter {
+public:
+    virtual ~FrameSplitter() = default;
+
+    // Splits a complete frame into parts. Returns false to forward the frame as is.
+    // parts is reused across calls, implementations should clear it instead of reallocating.
+    virtual bool split(const char* data, uint32_t len, std::vector<FramePart>& parts) = 0;
+};
+
+// Splits JSON array frames, e.g. [{"T":"q","S":"AAPL",...},{"T":"t","S":"MSFT",...}],
+// into one part per object keyed by its "S" field.
+class JsonArraySplitter final : public FrameSplitter {
+public:
+    // single_objects also splits frames of a single object, e.g. to decode it, see ProxyOptions::binary_market_data
+    explicit JsonArraySplitter(bool single_objects = false) noexcept : single_objects_(single_objects) {}
+
+    bool split(const char* data, uint32_t len, std::vector<FramePart>& parts) override {
+        parts.clear();
+        auto ok = json::forEachObject(data, len, [&parts](const char* obj, size_t n) {
+            parts.emplace_back(FramePart{ obj, static_cast<uint32_t>(n), json::findStringField(obj, obj + n, "\"S\"") });
+        });
+        // a single object is forwarded with its original framing
+        return ok && (parts.size() > 1 || (single_objects_ && parts.size() == 1));
+    }
+
+private:
+    bool single_objects_;
+};
+
+}
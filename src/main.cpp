@@ -27,6 +27,9 @@
 
 #ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
+#else
+#include <strings.h>
+#define _stricmp strcasecmp
 #endif
 
 using namespace websocket_proxy;
@@ -34,12 +37,33 @@ using namespace slick_logger;
 
 /**
 * Usage:
-* WebsocketsProxy.exe [-s <server_queue_size>] [-l <logging_level>]
+* WebsocketsProxy.exe [-s <server_queue_size>] [-l <logging_level>] [-r] [-c <client_queue_size>] [-x] [-w <spin_us>] [-b <batch_size>] [-t <io_threads>] [-H] [-P] [-N <numa_node>] [-m <max_chunk_size>] [-z] [-d <max_client_lag>] [-k <max_backoff_ms>] [-v] [-e]
 * 
 * Arguments:
 *   -s [optional]: Specify server to client queue size in Byte. Default to 16777216 Bytes.
 *   -l [optional]: Specify logging level. By default, logging will be disabled in release build.
 *                  Valid Logging level: OFF, CRITICAL, ERROR, WARNING, INFO, DEBUG, TRACE 
+*   -r [optional]: Route symbol data only to the subscribed clients through per-client queues.
+*                  Clients must subscribe through WebsocketProxyClient::subscribe to receive data.
+*   -c [optional]: Specify per-client data queue size in Byte when routing is enabled. Default to 4194304 Bytes.
+*   -x [optional]: Split batched JSON array frames into one message per object, e.g. one per symbol. Requires -r.
+*   -w [optional]: Microseconds to spin on an idle client queue before blocking until a client publishes.
+*                  Default to 50. -1 spins forever (lowest latency, keeps one core busy).
+*   -b [optional]: Max client requests handled per event loop iteration. Default to 64.
+*   -t [optional]: Number of io threads the upstream websockets are sharded across. Default to 0,
+*                  websockets run on the same thread as the client requests.
+*   -H [optional]: Back the shared memory queues with transparent huge pages (Linux).
+*   -P [optional]: Pre-fault the shared memory queues at startup.
+*   -N [optional]: Bind the shared memory queues to a NUMA node (Linux).
+*   -m [optional]: Upstream messages larger than this are streamed to clients in chunks. Default to 262144 Bytes.
+*   -z [optional]: Zero copy reads. Read the payload of large frames straight into the server queue.
+*   -d [optional]: Unregister clients lagging more than this many Bytes behind a queue. Default to 0, never.
+*   -k [optional]: Max backoff in milliseconds when reconnecting dropped upstream websockets. Default to 5000.
+*                  0 closes dropped websockets instead, clients have to open them again.
+*   -v [optional]: Cache the last quote and trade per symbol. A client subscribing to a symbol that is already
+*                  subscribed gets them right away. Requires -r.
+*   -e [optional]: Decode quotes, trades and bars into fixed-layout binary records instead of forwarding their JSON.
+*                  Clients receive them through onQuote, onTrade and onBar. Implies -x.
 */
 int main(int argc, char* argv[])
 {
@@ -56,10 +80,16 @@ int main(int argc, char* argv[])
     rotation.max_files = 10;                     // keep last 10 files
     config.sinks.push_back(std::make_shared<RotatingFileSink>("./Log/WebsocketProxy.log", rotation));
 
-    uint32_t server_queue_size = 1 << 24;   // 16MB
+    ProxyOptions options;
     [[maybe_unused]] bool log_level_set = false;
-    for (int i = 1; i < argc - 1; ++i) {
-        if (_stricmp(argv[i], "-l") == 0) {
+    for (int i = 1; i < argc; ++i) {
+        if (_stricmp(argv[i], "-r") == 0) {
+            options.route_by_symbol = true;
+        }
+        else if (_stricmp(argv[i], "-x") == 0) {
+            options.split_frames = true;
+        }
+        else if (_stricmp(argv[i], "-l") == 0 && i + 1 < argc) {
             std::string l = argv[++i];
             std::transform(l.begin(), l.end(), l.begin(), [](char c){ return std::tolower(c); });
             log_level_set = true;
@@ -88,15 +118,63 @@ int main(int argc, char* argv[])
                 log_level_set = false;
             }
         }
-        else if (_stricmp(argv[i], "-s") == 0) {
-            server_queue_size = atoi(argv[++i]);
+        else if (_stricmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            options.server_queue_size = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            options.client_queue_size = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            options.client_spin_us = atoll(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            options.client_batch_size = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options.io_threads = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-H") == 0) {
+            options.shm_placement.huge_pages = true;
+        }
+        else if (_stricmp(argv[i], "-P") == 0) {
+            options.shm_placement.prefault = true;
+        }
+        else if (_stricmp(argv[i], "-N") == 0 && i + 1 < argc) {
+            options.shm_placement.numa_node = atoi(argv[++i]);
         }
+        else if (_stricmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            options.max_chunk_size = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-z") == 0) {
+            options.zero_copy_reads = true;
+        }
+        else if (_stricmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            options.max_client_lag = atoll(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            options.max_reconnect_backoff_ms = atoi(argv[++i]);
+        }
+        else if (_stricmp(argv[i], "-v") == 0) {
+            options.last_value_cache = true;
+        }
+        else if (_stricmp(argv[i], "-e") == 0) {
+            options.binary_market_data = true;
+        }
+    }
+
+    if (options.split_frames && !options.route_by_symbol) {
+        fprintf(stderr, "-x requires -r\n");
+        return 1;
+    }
+    if (options.last_value_cache && !options.route_by_symbol) {
+        fprintf(stderr, "-v requires -r\n");
+        return 1;
     }
 
     Logger::instance().init(config);
 
     LOG_INFO(std::format("Start WebsocketProxy {} ...", VERSION));
-    WebsocketProxy proxy(server_queue_size);
+    WebsocketProxy proxy(options);
     proxy.run();
     LOG_INFO("WebsocketProxy Exit.");
 }
\ No newline at end of file
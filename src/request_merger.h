@@ -0,0 +1,286 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace websocket_proxy {
+
+// Merges subscription requests of the form
+//   {"action":"subscribe","trades":["AAPL"],"quotes":["AAPL"]}
+//   {"action":"subscribe","trades":["MSFT"]}
+// into a single request
+//   {"action":"subscribe","trades":["AAPL","MSFT"],"quotes":["AAPL"]}
+// Requests can be merged when they only contain string fields and arrays of strings,
+// have at least one array and their string fields (e.g. "action") are identical.
+class RequestMerger {
+    struct Field {
+        std::string key;        // raw JSON string token, quotes included
+        std::string value;      // raw JSON string token for a scalar field, items joined by ',' for an array
+        bool is_array;
+    };
+    std::vector<Field> fields_;
+    std::vector<Field> parsed_;
+    uint32_t count_ = 0;
+    uint32_t bytes_ = 0;
+
+public:
+    // Returns false if the request can't be merged with the pending ones. Nothing is added in that case.
+    bool add(const char* request, uint32_t len) {
+        if (!parse(std::string_view(request, len)) || !hasArray()) {
+            return false;
+        }
+
+        if (count_) {
+            // scalar fields must match, e.g. subscribe and unsubscribe are not merged
+            for (auto& field : parsed_) {
+                auto existing = find(fields_, field.key);
+                if (!field.is_array && (!existing || existing->is_array || existing->value != field.value)) {
+                    return false;
+                }
+                if (field.is_array && existing && !existing->is_array) {
+                    return false;
+                }
+            }
+            for (auto& field : fields_) {
+                if (!field.is_array && !find(parsed_, field.key)) {
+                    return false;
+                }
+            }
+        }
+
+        for (auto& field : parsed_) {
+            auto existing = find(fields_, field.key);
+            if (!existing) {
+                fields_.emplace_back(std::move(field));
+            }
+            else if (field.is_array) {
+                appendItems(*existing, field.value);
+            }
+        }
+        ++count_;
+        bytes_ += len;
+        return true;
+    }
+
+    bool empty() const noexcept { return count_ == 0; }
+    uint32_t count() const noexcept { return count_; }
+    // total size of the requests merged so far
+    uint32_t bytes() const noexcept { return bytes_; }
+
+    std::string build() const {
+        std::string out;
+        out.reserve(bytes_);
+        out.push_back('{');
+        for (auto& field : fields_) {
+            if (out.size() > 1) {
+                out.push_back(',');
+            }
+            out.append(field.key);
+            out.push_back(':');
+            if (field.is_array) {
+                out.push_back('[');
+                out.append(field.value);
+                out.push_back(']');
+            }
+            else {
+                out.append(field.value);
+            }
+        }
+        out.push_back('}');
+        return out;
+    }
+
+    void clear() noexcept {
+        fields_.clear();
+        count_ = 0;
+        bytes_ = 0;
+    }
+
+private:
+    static Field* find(std::vector<Field>& fields, const std::string& key) noexcept {
+        for (auto& field : fields) {
+            if (field.key == key) {
+                return &field;
+            }
+        }
+        return nullptr;
+    }
+
+    static void appendItems(Field& field, std::string_view items) {
+        // skip duplicates, e.g. two clients subscribing to the same symbol
+        size_t pos = 0;
+        while (pos < items.size()) {
+            auto next = nextItem(items, pos);
+            auto item = items.substr(pos, next - pos);
+            if (!containsItem(field.value, item)) {
+                if (!field.value.empty()) {
+                    field.value.push_back(',');
+                }
+                field.value.append(item);
+            }
+            pos = next + 1;
+        }
+    }
+
+    static size_t nextItem(std::string_view items, size_t pos) noexcept {
+        // items are string tokens, so a ',' outside of quotes ends the item
+        bool in_string = false;
+        for (; pos < items.size(); ++pos) {
+            auto c = items[pos];
+            if (c == '\\') {
+                ++pos;
+            }
+            else if (c == '"') {
+                in_string = !in_string;
+            }
+            else if (c == ',' && !in_string) {
+                break;
+            }
+        }
+        return pos;
+    }
+
+    static bool containsItem(std::string_view items, std::string_view item) noexcept {
+        size_t pos = 0;
+        while (pos < items.size()) {
+            auto next = nextItem(items, pos);
+            if (items.substr(pos, next - pos) == item) {
+                return true;
+            }
+            pos = next + 1;
+        }
+        return false;
+    }
+
+    static size_t skipWhitespace(std::string_view s, size_t pos) noexcept {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r' || s[pos] == '\n')) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    // Returns the end of the string token starting at pos, or npos.
+    static size_t stringEnd(std::string_view s, size_t pos) noexcept {
+        if (pos >= s.size() || s[pos] != '"') {
+            return std::string_view::npos;
+        }
+        for (++pos; pos < s.size(); ++pos) {
+            if (s[pos] == '\\') {
+                ++pos;
+            }
+            else if (s[pos] == '"') {
+                return pos + 1;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    bool parse(std::string_view s) {
+        parsed_.clear();
+        auto pos = skipWhitespace(s, 0);
+        if (pos >= s.size() || s[pos] != '{') {
+            return false;
+        }
+        pos = skipWhitespace(s, pos + 1);
+        if (pos < s.size() && s[pos] == '}') {
+            return false;
+        }
+
+        while (pos < s.size()) {
+            auto key_end = stringEnd(s, pos);
+            if (key_end == std::string_view::npos) {
+                return false;
+            }
+            Field field{ std::string(s.substr(pos, key_end - pos)), {}, false };
+            pos = skipWhitespace(s, key_end);
+            if (pos >= s.size() || s[pos] != ':') {
+                return false;
+            }
+            pos = skipWhitespace(s, pos + 1);
+            if (pos < s.size() && s[pos] == '[') {
+                field.is_array = true;
+                pos = skipWhitespace(s, pos + 1);
+                while (pos < s.size() && s[pos] != ']') {
+                    auto item_end = stringEnd(s, pos);
+                    if (item_end == std::string_view::npos) {
+                        return false;
+                    }
+                    if (!field.value.empty()) {
+                        field.value.push_back(',');
+                    }
+                    field.value.append(s.substr(pos, item_end - pos));
+                    pos = skipWhitespace(s, item_end);
+                    if (pos < s.size() && s[pos] == ',') {
+                        pos = skipWhitespace(s, pos + 1);
+                    }
+                    else if (pos >= s.size() || s[pos] != ']') {
+                        return false;
+                    }
+                }
+                if (pos >= s.size()) {
+                    return false;
+                }
+                ++pos;
+            }
+            else {
+                auto value_end = stringEnd(s, pos);
+                if (value_end == std::string_view::npos) {
+                    return false;
+                }
+                field.value.assign(s.substr(pos, value_end - pos));
+                pos = value_end;
+            }
+            if (find(parsed_, field.key)) {
+                return false;
+            }
+            parsed_.emplace_back(std::move(field));
+
+            pos = skipWhitespace(s, pos);
+            if (pos < s.size() && s[pos] == ',') {
+                pos = skipWhitespace(s, pos + 1);
+            }
+            else if (pos < s.size() && s[pos] == '}') {
+                return skipWhitespace(s, pos + 1) == s.size();
+            }
+            else {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool hasArray() const noexcept {
+        for (auto& field : parsed_) {
+            if (field.is_array) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}
@@ -0,0 +1,171 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "shm_placement.h"
+#include <websocket_proxy/platform.h>
+#include <slick_logger/logger.hpp>
+#include <fstream>
+#include <string>
+
+#ifndef _WIN32
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23  // Linux 5.14
+#endif
+#endif
+
+namespace websocket_proxy {
+
+namespace {
+
+size_t systemPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// madvise and mbind only accept page aligned ranges
+std::pair<char*, size_t> pageAligned(void* data, size_t len) {
+    auto page = systemPageSize();
+    auto begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+    auto end = (reinterpret_cast<uintptr_t>(data) + len) & ~(page - 1);
+    if (end <= begin) {
+        return { nullptr, 0 };
+    }
+    return { reinterpret_cast<char*>(begin), end - begin };
+}
+
+void touchPages(char* data, size_t len) {
+    auto page = systemPageSize();
+    for (size_t offset = 0; offset < len; offset += page) {
+        // nothing has been published yet, rewrite the byte to fault the page in writable
+        auto p = reinterpret_cast<volatile char*>(data + offset);
+        *p = *p;
+    }
+}
+
+}
+
+void applyShmPlacement(const char* name, void* data, size_t len, const ShmPlacement& placement) {
+    auto [begin, size] = pageAligned(data, len);
+    if (!size) {
+        return;
+    }
+
+#ifdef _WIN32
+    // Large pages and NUMA nodes have to be chosen when the mapping is created
+    if (placement.huge_pages || placement.numa_node >= 0) {
+        LOG_WARN("{}: huge pages and NUMA binding are not supported on Windows", name);
+    }
+#else
+    if (placement.huge_pages && madvise(begin, size, MADV_HUGEPAGE) != 0) {
+        LOG_WARN("{}: madvise(MADV_HUGEPAGE) failed. err={}", name, errno);
+    }
+
+    if (placement.numa_node >= 0) {
+        // bind before the first touch, pages that are already faulted in are moved
+        unsigned long nodemask[4] = {};
+        constexpr auto max_node = sizeof(nodemask) * 8;
+        if (static_cast<size_t>(placement.numa_node) >= max_node) {
+            LOG_WARN("{}: invalid NUMA node {}", name, placement.numa_node);
+        }
+        else {
+            nodemask[placement.numa_node / 64] |= 1UL << (placement.numa_node % 64);
+            if (syscall(SYS_mbind, begin, size, MPOL_BIND, nodemask, max_node, MPOL_MF_MOVE) != 0) {
+                LOG_WARN("{}: mbind to node {} failed. err={}", name, placement.numa_node, errno);
+            }
+        }
+    }
+#endif
+
+    if (placement.prefault) {
+#ifndef _WIN32
+        if (madvise(begin, size, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+#endif
+        touchPages(begin, size);
+    }
+}
+
+ShmPlacementReport queryShmPlacement(void* data, size_t len) {
+    ShmPlacementReport report;
+    report.page_size = systemPageSize();
+#ifndef _WIN32
+    // madvise and mbind split the mapping, look up the part that was placed
+    auto [begin, size] = pageAligned(data, len);
+    if (!size) {
+        return report;
+    }
+    // the first line of a smaps entry is the address range, followed by "Key: value kB" lines
+    auto addr = reinterpret_cast<uintptr_t>(begin);
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool found = false;
+    while (std::getline(smaps, line)) {
+        auto dash = line.find('-');
+        auto space = line.find(' ');
+        if (dash != std::string::npos && space != std::string::npos && dash < space && line.find(':') > space) {
+            if (found) {
+                break;
+            }
+            auto begin = std::stoull(line.substr(0, dash), nullptr, 16);
+            auto end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+            found = addr >= begin && addr < end;
+            if (found) {
+                report.bytes = end - begin;
+            }
+            continue;
+        }
+        if (!found) {
+            continue;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        auto key = line.substr(0, colon);
+        size_t kb = strtoull(line.c_str() + colon + 1, nullptr, 10);
+        if (key == "Rss") {
+            report.resident_bytes = kb << 10;
+        }
+        else if (key == "KernelPageSize") {
+            report.page_size = kb << 10;
+        }
+        else if (key == "ShmemPmdMapped" || key == "FilePmdMapped" || key == "AnonHugePages") {
+            report.huge_bytes += kb << 10;
+        }
+    }
+
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, begin, MPOL_F_NODE | MPOL_F_ADDR) == 0) {
+        report.numa_node = node;
+    }
+#endif
+    return report;
+}
+
+}
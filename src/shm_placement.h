@@ -0,0 +1,55 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace websocket_proxy {
+
+// Memory placement of the shared memory queues
+struct ShmPlacement {
+    // Back the queues with 2MB transparent huge pages. Requires
+    // /sys/kernel/mm/transparent_hugepage/shmem_enabled to be advise, within_size or always.
+    bool huge_pages = false;
+    // fault in every page at startup instead of on the first message written to it
+    bool prefault = false;
+    // NUMA node the queue memory is bound to, < 0 keeps the default policy
+    int32_t numa_node = -1;
+};
+
+struct ShmPlacementReport {
+    size_t bytes = 0;           // size of the mapping
+    size_t page_size = 0;       // kernel page size of the mapping
+    size_t huge_bytes = 0;      // bytes mapped by huge pages
+    size_t resident_bytes = 0;
+    int32_t numa_node = -1;     // node of the first page, -1 if unknown
+};
+
+// Applies the placement to [data, data + len). Must be called before the memory is first written.
+// Failures are logged, the queue keeps working with the default placement.
+void applyShmPlacement(const char* name, void* data, size_t len, const ShmPlacement& placement);
+
+// Page size, huge page and NUMA usage the kernel actually gave [data, data + len)
+ShmPlacementReport queryShmPlacement(void* data, size_t len);
+
+}
@@ -0,0 +1,412 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <websocket_proxy/types.h>
+#include <websocket_proxy/notifier.h>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace websocket_proxy {
+
+static_assert(kMaxClients % 64 == 0, "client slots are kept in 64 bit words");
+
+// Set of client slots
+struct ClientSet {
+    static constexpr uint32_t kWords = kMaxClients / 64;
+    uint64_t words[kWords] = {};
+
+    void set(uint32_t slot) noexcept { words[slot >> 6] |= 1ULL << (slot & 63); }
+    void reset(uint32_t slot) noexcept { words[slot >> 6] &= ~(1ULL << (slot & 63)); }
+    bool test(uint32_t slot) const noexcept { return words[slot >> 6] & (1ULL << (slot & 63)); }
+    void clear() noexcept { memset(words, 0, sizeof(words)); }
+
+    bool empty() const noexcept {
+        for (auto word : words) {
+            if (word) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // first slot not in the set, kMaxClients if full
+    uint32_t firstUnset() const noexcept {
+        for (uint32_t i = 0; i < kWords; ++i) {
+            if (~words[i]) {
+                return (i << 6) + std::countr_one(words[i]);
+            }
+        }
+        return kMaxClients;
+    }
+
+    template<typename Fn>
+    void forEach(Fn&& fn) const {
+        for (uint32_t i = 0; i < kWords; ++i) {
+            for (auto word = words[i]; word; word &= word - 1) {
+                fn((i << 6) + std::countr_zero(word));
+            }
+        }
+    }
+};
+
+// Interns symbols into dense ids. Only one thread adds symbols, any thread can look
+// them up without locking. Symbols are never removed, so ids stay valid.
+class SymbolTable {
+public:
+    static constexpr uint32_t kInvalidId = UINT32_MAX;
+
+    // capacity is the max number of symbols, arena_size the total bytes of their names
+    explicit SymbolTable(uint32_t capacity = 1 << 16, uint32_t arena_size = 1 << 20)
+        : capacity_(capacity)
+        , mask_(std::bit_ceil(capacity * 2) - 1)
+        , slots_(std::make_unique<Slot[]>(mask_ + 1))
+        , names_(std::make_unique<uint32_t[]>(capacity))
+        , arena_(std::make_unique<char[]>(arena_size))
+        , arena_size_(arena_size)
+    {}
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    uint32_t find(std::string_view symbol) const noexcept {
+        auto hash = hashOf(symbol);
+        for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+            auto& slot = slots_[i];
+            auto id = slot.id.load(std::memory_order_acquire);
+            if (id == kInvalidId) {
+                return kInvalidId;
+            }
+            if (slot.hash == hash && matches(slot, symbol)) {
+                return id;
+            }
+        }
+    }
+
+    // Returns the id of the symbol, adding it if needed. kInvalidId when the table is full.
+    uint32_t intern(std::string_view symbol) noexcept {
+        auto hash = hashOf(symbol);
+        auto i = hash & mask_;
+        for (;; i = (i + 1) & mask_) {
+            auto& slot = slots_[i];
+            auto id = slot.id.load(std::memory_order_relaxed);
+            if (id == kInvalidId) {
+                break;
+            }
+            if (slot.hash == hash && matches(slot, symbol)) {
+                return id;
+            }
+        }
+
+        if (size_ == capacity_ || arena_used_ + symbol.size() > arena_size_) {
+            return kInvalidId;
+        }
+        auto& slot = slots_[i];
+        memcpy(arena_.get() + arena_used_, symbol.data(), symbol.size());
+        slot.offset = arena_used_;
+        slot.len = static_cast<uint32_t>(symbol.size());
+        slot.hash = hash;
+        arena_used_ += slot.len;
+        auto id = size_++;
+        names_[id] = i;
+        // publishes the name and hash to the readers
+        slot.id.store(id, std::memory_order_release);
+        return id;
+    }
+
+    std::string_view name(uint32_t id) const noexcept {
+        auto& slot = slots_[names_[id]];
+        return std::string_view(arena_.get() + slot.offset, slot.len);
+    }
+
+    uint32_t size() const noexcept { return size_; }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> id{ kInvalidId };
+        uint32_t hash = 0;
+        uint32_t offset = 0;
+        uint32_t len = 0;
+    };
+
+    static uint32_t hashOf(std::string_view symbol) noexcept {
+        auto hash = std::hash<std::string_view>()(symbol);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    bool matches(const Slot& slot, std::string_view symbol) const noexcept {
+        return slot.len == symbol.size() && memcmp(arena_.get() + slot.offset, symbol.data(), slot.len) == 0;
+    }
+
+    const uint32_t capacity_;
+    const uint32_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<uint32_t[]> names_;     // id to slot index
+    std::unique_ptr<char[]> arena_;
+    const uint32_t arena_size_;
+    uint32_t arena_used_ = 0;
+    uint32_t size_ = 0;
+};
+
+// A message of one writer thread, read by another through a seqlock. Messages larger than kMaxLen are not stored.
+struct ValueSlot {
+    static constexpr uint32_t kMaxLen = 496;
+
+    std::atomic<uint32_t> seq{ 0 };
+    uint32_t len = 0;
+    uint64_t recv_time = 0;
+    char data[kMaxLen];
+
+    // wrap adds the array framing of a frame, e.g. to an object split out of one. Returns false if too large.
+    bool store(const char* value, uint32_t value_len, bool wrap, uint64_t value_recv_time) noexcept {
+        auto total = wrap ? value_len + 2 : value_len;
+        if (total > kMaxLen) {
+            return false;
+        }
+        auto s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        if (wrap) {
+            data[0] = '[';
+            memcpy(data + 1, value, value_len);
+            data[total - 1] = ']';
+        }
+        else {
+            memcpy(data, value, value_len);
+        }
+        len = total;
+        recv_time = value_recv_time;
+        seq.store(s + 2, std::memory_order_release);
+        return true;
+    }
+
+    // Drops the message, load returns 0 until the next store. Writer thread only.
+    void clear() noexcept {
+        auto s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        len = 0;
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Copies the message to out, at least kMaxLen bytes. Returns its length, 0 if there is none.
+    uint32_t load(char* out, uint64_t& out_recv_time) const noexcept {
+        for (;;) {
+            auto s = seq.load(std::memory_order_acquire);
+            if (s & 1) {
+                cpu_relax();
+                continue;
+            }
+            auto n = len;
+            out_recv_time = recv_time;
+            memcpy(out, data, n);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s) {
+                return n;
+            }
+            cpu_relax();
+        }
+    }
+};
+
+// Last quote and trade of a symbol, written by the io thread of the websocket and read on the control thread
+struct LastValue {
+    static constexpr uint32_t kQuote = 0;   // SubscriptionType::Quotes
+    static constexpr uint32_t kTrade = 1;   // SubscriptionType::Trades
+    ValueSlot slots[2];
+
+    void clear() noexcept {
+        slots[kQuote].clear();
+        slots[kTrade].clear();
+    }
+};
+
+// Latest quote of a symbol not yet delivered to a client that receives quotes conflated.
+// The io thread of the websocket stores it and sets pending, the control thread delivers it.
+struct ConflatedValue {
+    ValueSlot value;
+    std::atomic_bool pending{ false };
+};
+
+// Subscriptions of one websocket keyed by symbol id, open addressed with linear probing.
+// Entries are never removed, an entry without clients is not subscribed. Only one thread
+// modifies the table, the data path reads it without locking.
+// Allocated up front, each websocket's table takes sizeof(Entry) * 16384 bytes by default, about
+// 2MB with kMaxClients 256. The bitsets, and so the table, grow with kMaxClients.
+class SubscriptionTable {
+public:
+    struct Entry {
+        std::atomic<uint32_t> symbol_id{ SymbolTable::kInvalidId };
+        // SubscriptionType bits sent upstream
+        std::atomic<uint8_t> type{ 0 };
+        std::atomic<uint64_t> clients[ClientSet::kWords] = {};
+        // allocated with the first value when the proxy caches last values
+        std::atomic<LastValue*> last_value{ nullptr };
+        // slots receiving quotes conflated, they are also in clients
+        std::atomic<uint64_t> conflated[ClientSet::kWords] = {};
+        // by client slot, allocated on the control thread when the slot subscribes conflated
+        std::unique_ptr<std::atomic<ConflatedValue*>[]> conflated_values;
+        // slots in clients still waiting for the last values, not routed to until they are sent.
+        // Set on the control thread, cleared by the websocket's io thread once it sent them.
+        std::atomic<uint64_t> snapshot_pending[ClientSet::kWords] = {};
+
+        // acquire, conflated_values is set before the bit
+        bool isConflated(uint32_t slot) const noexcept {
+            return conflated[slot >> 6].load(std::memory_order_acquire) & (1ULL << (slot & 63));
+        }
+
+        bool hasConflated() const noexcept {
+            for (auto& word : conflated) {
+                if (word.load(std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void addClient(uint32_t slot) noexcept {
+            clients[slot >> 6].fetch_or(1ULL << (slot & 63), std::memory_order_relaxed);
+        }
+
+        void removeClient(uint32_t slot) noexcept {
+            clients[slot >> 6].fetch_and(~(1ULL << (slot & 63)), std::memory_order_relaxed);
+            conflated[slot >> 6].fetch_and(~(1ULL << (slot & 63)), std::memory_order_relaxed);
+            snapshot_pending[slot >> 6].fetch_and(~(1ULL << (slot & 63)), std::memory_order_relaxed);
+        }
+
+        // before addClient, so the slot isn't routed to before its snapshot
+        void setSnapshotPending(uint32_t slot) noexcept {
+            snapshot_pending[slot >> 6].fetch_or(1ULL << (slot & 63), std::memory_order_release);
+        }
+
+        bool isSnapshotPending(uint32_t slot) const noexcept {
+            return snapshot_pending[slot >> 6].load(std::memory_order_acquire) & (1ULL << (slot & 63));
+        }
+
+        void clearSnapshotPending(uint32_t slot) noexcept {
+            snapshot_pending[slot >> 6].fetch_and(~(1ULL << (slot & 63)), std::memory_order_release);
+        }
+
+        bool hasClients() const noexcept {
+            for (auto& word : clients) {
+                if (word.load(std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // adds the subscribed clients to set, except those still waiting for their snapshot
+        void collectClients(ClientSet& set) const noexcept {
+            for (uint32_t i = 0; i < ClientSet::kWords; ++i) {
+                set.words[i] |= clients[i].load(std::memory_order_relaxed) & ~snapshot_pending[i].load(std::memory_order_acquire);
+            }
+        }
+    };
+
+    explicit SubscriptionTable(uint32_t capacity = 1 << 14)
+        : capacity_(capacity - capacity / 4)
+        , mask_(std::bit_ceil(capacity) - 1)
+        , entries_(std::make_unique<Entry[]>(mask_ + 1))
+    {}
+
+    ~SubscriptionTable() {
+        for (uint32_t i = 0; i <= mask_; ++i) {
+            auto& entry = entries_[i];
+            delete entry.last_value.load(std::memory_order_relaxed);
+            if (entry.conflated_values) {
+                for (uint32_t slot = 0; slot < kMaxClients; ++slot) {
+                    delete entry.conflated_values[slot].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    SubscriptionTable(const SubscriptionTable&) = delete;
+    SubscriptionTable& operator=(const SubscriptionTable&) = delete;
+
+    const Entry* find(uint32_t symbol_id) const noexcept {
+        for (auto i = slotOf(symbol_id);; i = (i + 1) & mask_) {
+            auto& entry = entries_[i];
+            auto id = entry.symbol_id.load(std::memory_order_acquire);
+            if (id == symbol_id) {
+                return &entry;
+            }
+            if (id == SymbolTable::kInvalidId) {
+                return nullptr;
+            }
+        }
+    }
+
+    Entry* find(uint32_t symbol_id) noexcept {
+        return const_cast<Entry*>(std::as_const(*this).find(symbol_id));
+    }
+
+    // Returns the entry of the symbol, adding an empty one if needed. nullptr when the table is full.
+    Entry* insert(uint32_t symbol_id) noexcept {
+        auto i = slotOf(symbol_id);
+        for (;; i = (i + 1) & mask_) {
+            auto id = entries_[i].symbol_id.load(std::memory_order_relaxed);
+            if (id == symbol_id) {
+                return &entries_[i];
+            }
+            if (id == SymbolTable::kInvalidId) {
+                break;
+            }
+        }
+        if (size_ == capacity_) {
+            return nullptr;
+        }
+        ++size_;
+        entries_[i].symbol_id.store(symbol_id, std::memory_order_release);
+        return &entries_[i];
+    }
+
+    // Removes the client from every subscription, e.g. before its slot is reused
+    void removeClient(uint32_t slot) noexcept {
+        for (uint32_t i = 0; i <= mask_; ++i) {
+            auto& entry = entries_[i];
+            if (entry.symbol_id.load(std::memory_order_relaxed) != SymbolTable::kInvalidId) {
+                entry.removeClient(slot);
+            }
+        }
+    }
+
+private:
+    uint32_t slotOf(uint32_t symbol_id) const noexcept {
+        // ids are dense, spread neighbouring ids over the table
+        return (symbol_id * 0x9E3779B1u) & mask_;
+    }
+
+    const uint32_t capacity_;
+    const uint32_t mask_;
+    std::unique_ptr<Entry[]> entries_;
+    uint32_t size_ = 0;
+};
+
+}
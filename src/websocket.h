@@ -24,6 +24,12 @@
 #include <slick_queue/slick_queue.h>
 #include <slick_logger/logger.hpp>
 #include "websocket_proxy.h"
+#include "request_merger.h"
+#include "symbol_table.h"
+#include <websocket_proxy/latency_histogram.h>
+#include <algorithm>
+#include <deque>
+#include <optional>
 #include <unordered_set>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
@@ -33,7 +39,6 @@
 #include <boost/asio/spawn.hpp>
 #include <cstdlib>
 #include <atomic>
-#include <winrt/Windows.Foundation.h>
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -55,10 +60,61 @@ class Websocket : public std::enable_shared_from_this<Websocket>
     asio::io_context& ioc_;
     ssl::context& ctx_;
     WebsocketProxy* proxy_ = nullptr;
+    // All operations on the connection run on this strand of its io worker
+    asio::strand<asio::io_context::executor_type> strand_;
     tcp::resolver resolver_;
-    websocket::stream<ssl::stream<beast::tcp_stream>> ws_;
+    // recreated for every reconnect, a stream can't be reused once it failed
+    std::optional<websocket::stream<ssl::stream<beast::tcp_stream>>> ws_;
+    // dropped connections are reopened with exponential backoff up to this, 0 closes them
+    const uint32_t max_backoff_ms_;
+    uint32_t reconnect_attempts_ = 0;
+    asio::steady_timer reconnect_timer_;
     beast::flat_buffer r_buffer_;
-    beast::multi_buffer w_buffer_;
+    // messages larger than this are delivered in chunks
+    uint32_t max_chunk_size_;
+    // chunks of the current message have been delivered
+    bool chunked_ = false;
+
+    // Zero copy reads: once the size of a frame is known, the rest of its payload is read
+    // straight into a reserved server queue slot instead of r_buffer_
+    const bool zero_copy_;
+    struct DirectChunk
+    {
+        WsData* data = nullptr;
+        uint64_t index = 0;
+        uint32_t size = 0;      // reserved message size
+        uint32_t len = 0;       // payload bytes of the chunk
+        uint32_t filled = 0;
+    };
+    DirectChunk direct_;
+
+    // Outbound messages are written one at a time. Messages of the same client queued while a
+    // write is in flight are merged into one frame when possible, see RequestMerger.
+    struct PendingWrite
+    {
+        std::string data;
+        uint64_t enqueue_time;
+        // the client whose request this is, 0 for requests owned by the proxy
+        uint64_t client_pid = 0;
+    };
+    std::deque<PendingWrite> write_queue_;
+    RequestMerger write_merger_;
+    bool writing_ = false;
+    // close() was called during a write, the stream is closed once it completed
+    bool close_pending_ = false;
+    std::atomic<uint64_t> queued_bytes_{ 0 };
+    std::atomic<uint64_t> queued_messages_{ 0 };
+    std::atomic<uint64_t> frames_written_{ 0 };
+    std::atomic<uint64_t> bytes_written_{ 0 };
+    std::atomic<uint64_t> frames_read_{ 0 };
+    std::atomic<uint64_t> bytes_read_{ 0 };
+    // times this connection was reestablished after dropping
+    std::atomic<uint64_t> reconnects_{ 0 };
+    std::atomic<uint64_t> messages_merged_{ 0 };
+    // enqueue to write completion, in ns
+    LatencyHistogram write_latency_;
+    // read completion to published to the clients, in ns
+    LatencyHistogram read_latency_;
     std::string url_;
     std::string api_key_;
     std::string host_;
@@ -68,15 +124,36 @@ class Websocket : public std::enable_shared_from_this<Websocket>
 
     std::unordered_set<uint64_t> clients_;
 
-    struct Subscription
+    // keyed by WebsocketProxy::symbols_ ids, clients by slot
+    SubscriptionTable subscriptions_;
+    // subscribe requests sent upstream per symbol id, replayed after a reconnect. Control thread only.
+    std::unordered_map<uint32_t, std::vector<std::string>> subscribe_requests_;
+
+    // Proxy owned authentication, see WebsocketProxy::handleAuth.
+    // The request and the markers are owned by the strand, the request is sent again after a reconnect.
+    std::string auth_request_;
+    std::string auth_success_;
+    std::string auth_failure_;
+    // frames are checked for the markers while waiting for the reply
+    bool auth_pending_ = false;
+    // control thread only
+    enum class AuthState : uint8_t
     {
-        uint8_t type_ = SubscriptionType::None;
-        std::unordered_set<uint64_t> clients_;
-
-        Subscription() = default;
-        Subscription(SubscriptionType type) : type_(type) {}
+        None,
+        Pending,
+        // no reply in time, the strand still checks the frames for one. Not sent again until a reconnect.
+        TimedOut,
+        Authenticated,
     };
-    std::unordered_map<std::string, Subscription> subscriptions_;
+    AuthState auth_state_ = AuthState::None;
+    std::string auth_response_;
+    std::vector<RequestRef> auth_waiting_;
+    uint64_t auth_start_time_ = 0;
+    // the strand holds an auth_request_ and sends it first after a reconnect
+    bool has_auth_request_ = false;
+    bool replay_after_auth_ = false;
+    // between losing the connection and replaying the subscriptions, subscription requests aren't sent
+    bool reconnecting_ = false;
 
     enum Status : uint8_t 
     {
@@ -84,17 +161,23 @@ class Websocket : public std::enable_shared_from_this<Websocket>
         CONNECTED,
         DISCONNECTING,
         DISCONNECTED,
+        RECONNECTING,
     };
     std::atomic<Status> status_{ Status::DISCONNECTED };
     
 public:
     // Resolver and socket require an io_context
-    explicit Websocket(WebsocketProxy* proxy, asio::io_context& ioc, ssl::context& ctx, uint64_t id, std::string url, std::string api_key)
+    explicit Websocket(WebsocketProxy* proxy, asio::io_context& ioc, ssl::context& ctx, uint64_t id, std::string url, std::string api_key, uint32_t max_chunk_size)
         : ioc_(ioc)
         , ctx_(ctx)
         , proxy_(proxy)
-        , resolver_(asio::make_strand(ioc))
-        , ws_(asio::make_strand(ioc), ctx)
+        , strand_(asio::make_strand(ioc))
+        , resolver_(strand_)
+        , ws_(std::in_place, strand_, ctx)
+        , max_backoff_ms_(proxy->options_.max_reconnect_backoff_ms)
+        , reconnect_timer_(strand_)
+        , max_chunk_size_(max_chunk_size)
+        , zero_copy_(proxy->options_.zero_copy_reads)
         , url_(std::move(url))
         , api_key_(std::move(api_key))
         , id_(id)
@@ -151,6 +234,8 @@ public:
 
     uint64_t id() const noexcept { return id_; }
 
+    const asio::strand<asio::io_context::executor_type>& executor() const noexcept { return strand_; }
+
     std::unordered_set<uint64_t>& clients() noexcept { return clients_; }
 
     // Start the asynchronous operation
@@ -166,46 +251,46 @@ public:
         }
 
         // Set a timeout on the operation
-        beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
+        beast::get_lowest_layer(*ws_).expires_after(std::chrono::seconds(30));
 
         // Make the connection on the IP address we get from a lookup
-        auto ep = beast::get_lowest_layer(ws_).async_connect(result, yield[ec]);
+        auto ep = beast::get_lowest_layer(*ws_).async_connect(result, yield[ec]);
         if (ec) {
             return fail(ec, "connect", &callback);
         }
 
         // Set SNI Hostname (many hosts need this to handshake successfully)
-        if(!SSL_set_tlsext_host_name(ws_.next_layer().native_handle(), host_.c_str()))
+        if(!SSL_set_tlsext_host_name(ws_->next_layer().native_handle(), host_.c_str()))
         {
             auto ec = beast::error_code(static_cast<int>(::ERR_get_error()), asio::error::get_ssl_category());
             return fail(ec, "connect", &callback);
         }
 
-        // Update the host string. This will provide the value of the
+        // The host string with the port provides the value of the
         // Host HTTP header during the WebSocket handshake.
         // See https://tools.ietf.org/html/rfc7230#section-5.4
-        host_ += ':' + std::to_string(ep.port());
+        auto host = host_ + ':' + std::to_string(ep.port());
 
         // Set a timeout on the operation
-        beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
+        beast::get_lowest_layer(*ws_).expires_after(std::chrono::seconds(30));
 
         // Perform the SSL handshake
-        ws_.next_layer().async_handshake(ssl::stream_base::client, yield[ec]);
+        ws_->next_layer().async_handshake(ssl::stream_base::client, yield[ec]);
         if (ec) {
             return fail(ec, "ssl_handshake", &callback);
         }
 
         // Turn off the timeout on the tcp_stream, because
         // the websocket stream has its own timeout system.
-        beast::get_lowest_layer(ws_).expires_never();
+        beast::get_lowest_layer(*ws_).expires_never();
 
         // Set suggested timeout settings for the websocket
-        ws_.set_option(
+        ws_->set_option(
             websocket::stream_base::timeout::suggested(
                 beast::role_type::client));
 
         // Set a decorator to change the User-Agent of the handshake
-        ws_.set_option(websocket::stream_base::decorator(
+        ws_->set_option(websocket::stream_base::decorator(
             [](websocket::request_type& req)
             {
                 req.set(http::field::user_agent,
@@ -214,94 +299,433 @@ public:
             }));
 
         // Perform the websocket handshake
-        ws_.async_handshake(host_, path_, yield[ec]);
+        ws_->async_handshake(host, path_, yield[ec]);
         if (ec) {
             return fail(ec, "handshake", &callback);
         }
 
+        if (status_.load(std::memory_order_relaxed) != Status::CONNECTING)
+        {
+            // closed once the handshake had completed
+            callback(false);
+            return;
+        }
         LOG_INFO("Websocket {} connected, id={}", url_, id_);
         status_.store(Status::CONNECTED, std::memory_order_release);
+
+        if (reconnect_attempts_)
+        {
+            // the proxy's own requests queued during the outage are stale, the subscriptions are replayed instead
+            std::erase_if(write_queue_, [this](const PendingWrite& pending) {
+                if (pending.client_pid)
+                {
+                    return false;
+                }
+                queued_bytes_.fetch_sub(pending.data.size(), std::memory_order_relaxed);
+                queued_messages_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            });
+        }
+
+        if (!auth_request_.empty())
+        {
+            // reconnected, authenticate before anything queued during the outage is written
+            queued_bytes_.fetch_add(auth_request_.size(), std::memory_order_relaxed);
+            queued_messages_.fetch_add(1, std::memory_order_relaxed);
+            write_queue_.emplace_front(PendingWrite{ auth_request_, get_monotonic_ns() });
+            auth_pending_ = true;
+        }
+
+        // flush messages queued while connecting
+        if (!writing_)
+        {
+            write();
+        }
     
         // start read messages
-        ws_.async_read(
-            r_buffer_,
-            beast::bind_front_handler(
-                &Websocket::on_read,
-                shared_from_this()));
+        read();
 
         callback(true);
     }
 
     void close()
     {
-        if (status_.load(std::memory_order_relaxed) < Status::DISCONNECTING)
+        if (!strand_.running_in_this_thread())
+        {
+            asio::dispatch(strand_, [self = shared_from_this()]() { self->close(); });
+            return;
+        }
+
+        auto status = status_.load(std::memory_order_relaxed);
+        if (status == Status::RECONNECTING || status == Status::CONNECTING)
+        {
+            // nothing to close while waiting for the next attempt. A pending resolve, connect or
+            // handshake is aborted, open() then fails without retrying.
+            LOG_INFO("Closing {}:{} while {}", host_, port_, status == Status::CONNECTING ? "connecting" : "reconnecting");
+            reconnect_timer_.cancel();
+            resolver_.cancel();
+            beast::error_code ignored;
+            beast::get_lowest_layer(*ws_).socket().close(ignored);
+            status_.store(Status::DISCONNECTED, std::memory_order_release);
+            proxy_->onWsClosed(id_);
+        }
+        else if (status_.load(std::memory_order_relaxed) < Status::DISCONNECTING)
         {
             LOG_INFO("Closing {}:{}...", host_, port_);
             status_.store(Status::DISCONNECTING, std::memory_order_release);
-            // Close the WebSocket connection
-            ws_.async_close(
-                websocket::close_code::normal,
-                beast::bind_front_handler(
-                    &Websocket::on_close,
-                    shared_from_this()));
+            if (writing_)
+            {
+                // a close can't overlap a write, see on_write
+                close_pending_ = true;
+                return;
+            }
+            closeStream();
+        }
+    }
+
+    // client_pid is reported if the write fails, 0 for requests of the proxy
+    void send(const char* buffer, size_t len, uint64_t client_pid = 0)
+    {
+        LOG_DEBUG("--> {}", std::string_view(buffer, len));
+        queued_bytes_.fetch_add(len, std::memory_order_relaxed);
+        queued_messages_.fetch_add(1, std::memory_order_relaxed);
+        PendingWrite pending{ std::string(buffer, len), get_monotonic_ns(), client_pid };
+        if (strand_.running_in_this_thread())
+        {
+            enqueue(std::move(pending));
+            return;
+        }
+        // called from the control thread, the write queue is owned by the strand
+        asio::dispatch(strand_, [self = shared_from_this(), pending = std::move(pending)]() mutable {
+            self->enqueue(std::move(pending));
+        });
+    }
+
+    // Sends the authentication request, then checks the frames read for the success and failure markers.
+    // Called from the control thread.
+    void authenticate(std::string request, std::string success, std::string failure)
+    {
+        asio::dispatch(strand_, [self = shared_from_this(), request = std::move(request), success = std::move(success), failure = std::move(failure)]() mutable {
+            self->auth_request_ = std::move(request);
+            self->auth_success_ = std::move(success);
+            self->auth_failure_ = std::move(failure);
+            self->auth_pending_ = true;
+            self->send(self->auth_request_.c_str(), self->auth_request_.size());
+        });
+    }
+
+    uint64_t queuedBytes() const noexcept { return queued_bytes_.load(std::memory_order_relaxed); }
+    uint64_t queuedMessages() const noexcept { return queued_messages_.load(std::memory_order_relaxed); }
+    uint64_t framesWritten() const noexcept { return frames_written_.load(std::memory_order_relaxed); }
+    uint64_t bytesWritten() const noexcept { return bytes_written_.load(std::memory_order_relaxed); }
+    uint64_t framesRead() const noexcept { return frames_read_.load(std::memory_order_relaxed); }
+    uint64_t bytesRead() const noexcept { return bytes_read_.load(std::memory_order_relaxed); }
+    uint8_t status() const noexcept { return status_.load(std::memory_order_relaxed); }
+    uint64_t reconnects() const noexcept { return reconnects_.load(std::memory_order_relaxed); }
+    uint64_t messagesMerged() const noexcept { return messages_merged_.load(std::memory_order_relaxed); }
+    const LatencyHistogram& writeLatency() const noexcept { return write_latency_; }
+    const LatencyHistogram& readLatency() const noexcept { return read_latency_; }
+
+    void resetLatency() noexcept
+    {
+        write_latency_.reset();
+        read_latency_.reset();
+    }
+
+private:
+    void enqueue(PendingWrite&& pending)
+    {
+        write_queue_.emplace_back(std::move(pending));
+        if (!writing_)
+        {
+            write();
         }
     }
 
-    void send(const char* buffer, size_t len)
+    void closeStream()
     {
-        LOG_DEBUG("--> {}", std::string(buffer, len));
-        auto n = asio::buffer_copy(w_buffer_.prepare(len), asio::buffer(buffer, len));
-        w_buffer_.commit(n);
-        ws_.async_write(
-            w_buffer_.data(),
+        ws_->async_close(
+            websocket::close_code::normal,
+            beast::bind_front_handler(
+                &Websocket::on_close,
+                shared_from_this()));
+    }
+
+    void write()
+    {
+        if (write_queue_.empty() || status_.load(std::memory_order_relaxed) != Status::CONNECTED)
+        {
+            writing_ = false;
+            return;
+        }
+
+        mergePendingWrites();
+        writing_ = true;
+        auto& front = write_queue_.front();
+        ws_->async_write(
+            asio::buffer(front.data),
             beast::bind_front_handler(
                 &Websocket::on_write,
                 shared_from_this()));
     }
 
-private:
+    // Merges the mergeable messages of one client at the head of the queue into one
+    void mergePendingWrites()
+    {
+        if (write_queue_.size() < 2)
+        {
+            return;
+        }
+
+        size_t n = 0;
+        auto client_pid = write_queue_.front().client_pid;
+        for (auto& pending : write_queue_)
+        {
+            if (pending.client_pid != client_pid || !write_merger_.add(pending.data.c_str(), static_cast<uint32_t>(pending.data.size())))
+            {
+                break;
+            }
+            ++n;
+        }
+
+        if (n > 1)
+        {
+            PendingWrite merged{ write_merger_.build(), write_queue_.front().enqueue_time, client_pid };
+            uint64_t bytes = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                bytes += write_queue_.front().data.size();
+                write_queue_.pop_front();
+            }
+            queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+            queued_bytes_.fetch_add(merged.data.size(), std::memory_order_relaxed);
+            queued_messages_.fetch_sub(n - 1, std::memory_order_relaxed);
+            messages_merged_.fetch_add(n, std::memory_order_relaxed);
+            LOG_DEBUG("{}: merged {} pending messages", id_, n);
+            write_queue_.emplace_front(std::move(merged));
+        }
+        write_merger_.clear();
+    }
+
     void on_write(beast::error_code ec, std::size_t bytes_transferred)
     {
+        uint64_t client_pid = 0;
+        bool resend = false;
+        if (!write_queue_.empty())
+        {
+            auto& front = write_queue_.front();
+            client_pid = front.client_pid;
+            auto status = status_.load(std::memory_order_relaxed);
+            // cut off by a dropped connection, stays at the front to be sent again once reconnected
+            resend = ec && max_backoff_ms_ && !close_pending_ && (status == Status::CONNECTED || status == Status::RECONNECTING);
+            if (!resend)
+            {
+                queued_bytes_.fetch_sub(front.data.size(), std::memory_order_relaxed);
+                queued_messages_.fetch_sub(1, std::memory_order_relaxed);
+                if (!ec)
+                {
+                    write_latency_.record(get_monotonic_ns() - front.enqueue_time);
+                }
+                write_queue_.pop_front();
+            }
+        }
+
+        if (close_pending_)
+        {
+            writing_ = false;
+            close_pending_ = false;
+            closeStream();
+            return;
+        }
+
         if(ec)
         {
-            if (status_.load(std::memory_order_relaxed) != Status::DISCONNECTED &&
-                ec != beast::websocket::error::closed && ec != asio::error::eof &&
-                ec != asio::error::operation_aborted) {
-                fail(ec, "write", nullptr, true);
+            writing_ = false;
+            if (client_pid)
+            {
+                LOG_WARN("{}: write of client {} {}", id_, client_pid, resend ? "interrupted, resent once reconnected" : "failed");
             }
+            connectionLost(ec, "write");
             return;
         }
-        // LOG_TRACE("{}: {}({}) bytes written", id_, bytes_transferred, w_buffer_.size());
-        w_buffer_.consume(bytes_transferred);
+        // LOG_TRACE("{}: {}({}) bytes written", id_, bytes_transferred, write_queue_.size());
+        frames_written_.fetch_add(1, std::memory_order_relaxed);
+        bytes_written_.fetch_add(bytes_transferred, std::memory_order_relaxed);
+        write();
     }
 
     void on_read(beast::error_code ec, std::size_t bytes_transferred)
     {
         if(ec)
         {
-            if (status_.load(std::memory_order_relaxed) != Status::DISCONNECTED &&
-                ec != beast::websocket::error::closed && ec != asio::error::eof &&
-                ec != asio::error::operation_aborted) {
-                fail(ec, "read", nullptr, true);
+            connectionLost(ec, "read");
+            return;
+        }
+
+        auto recv_time = get_monotonic_ns();
+        bytes_read_.fetch_add(bytes_transferred, std::memory_order_relaxed);
+        // deliver complete messages, or a chunk once max_chunk_size_ bytes of a large message are buffered
+        auto done = ws_->is_message_done();
+        if (done)
+        {
+            frames_read_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (!done && zero_copy_ && startDirectRead())
+        {
+            return;
+        }
+
+        if (done || r_buffer_.size() >= max_chunk_size_)
+        {
+            auto remaining = done ? 0 : remainingHint();
+            auto data = (const char*)r_buffer_.data().data();
+            auto size = static_cast<uint32_t>(r_buffer_.size());
+            LOG_TRACE("<-- {}", std::string_view(data, size));
+            if (auth_pending_) [[unlikely]]
+            {
+                checkAuthResponse(std::string_view(data, size));
             }
+            proxy_->onWsData(*this, data, size, remaining, chunked_ || !done, recv_time);
+            read_latency_.record(get_monotonic_ns() - recv_time);
+            chunked_ = !done;
+            r_buffer_.consume(size);
+        }
+
+        if (status_.load(std::memory_order_relaxed) == Status::CONNECTED) {
+            read();
+        }
+    }
+
+    void checkAuthResponse(std::string_view frame)
+    {
+        bool success = !auth_success_.empty() && frame.find(auth_success_) != std::string_view::npos;
+        bool failed = !success && !auth_failure_.empty() && frame.find(auth_failure_) != std::string_view::npos;
+        if (!success && !failed)
+        {
+            return;
+        }
+        auth_pending_ = false;
+        if (failed)
+        {
+            // not sent again after a reconnect
+            auth_request_.clear();
+        }
+        proxy_->onWsAuthenticated(id_, success, frame);
+    }
+
+    // exact when the rest of the message is in one frame, a lower bound otherwise
+    uint32_t remainingHint()
+    {
+        return static_cast<uint32_t>(std::clamp<size_t>(ws_->read_size_hint(1), 1, UINT32_MAX));
+    }
+
+    // Reserves a server queue slot for the next chunk and reads into it. The payload already
+    // in r_buffer_ is copied to the slot first. Returns false if the message has to be
+    // buffered, i.e. it may be routed or split as a whole, or if the rest of the chunk hasn't
+    // arrived yet. The slot blocks every queue reader until published, it is only held for data
+    // already received.
+    bool startDirectRead()
+    {
+        auto head = static_cast<uint32_t>(r_buffer_.size());
+        auto frame_remaining = remainingHint();
+        if (!chunked_ && !proxy_->broadcastsAll() && uint64_t(head) + frame_remaining <= max_chunk_size_)
+        {
+            return false;
+        }
+        auto len = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(head) + frame_remaining, max_chunk_size_));
+        if (len <= head || !received(len - head))
+        {
+            return false;
+        }
+
+        auto [data, index, size] = proxy_->reserveWsData(id_, len);
+        if (head)
+        {
+            memcpy(data->data, r_buffer_.data().data(), head);
+            r_buffer_.consume(head);
+        }
+        direct_ = DirectChunk{ data, index, size, len, head };
+        readDirect();
+        return true;
+    }
+
+    // Whether the socket holds at least len more payload bytes. Conservative, the bytes counted
+    // are still TLS records and the TLS stream may have some decrypted already.
+    bool received(uint32_t len)
+    {
+        beast::error_code ec;
+        auto available = beast::get_lowest_layer(*ws_).socket().available(ec);
+        // record and frame headers
+        auto overhead = (uint64_t(len) / 16384 + 1) * 64;
+        return !ec && available >= len + overhead;
+    }
+
+    void readDirect()
+    {
+        ws_->async_read_some(
+            asio::buffer(direct_.data->data + direct_.filled, direct_.len - direct_.filled),
+            beast::bind_front_handler(
+                &Websocket::on_read_direct,
+                shared_from_this()));
+    }
+
+    void on_read_direct(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        auto recv_time = get_monotonic_ns();
+        bytes_read_.fetch_add(bytes_transferred, std::memory_order_relaxed);
+        direct_.filled += static_cast<uint32_t>(bytes_transferred);
+        auto done = !ec && ws_->is_message_done();
+        if (done)
+        {
+            frames_read_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (!ec && !done && direct_.filled < direct_.len && received(direct_.len - direct_.filled))
+        {
+            readDirect();
             return;
         }
+        // The slot is published even on error, readers can't get past an unpublished slot.
+        // It is published short if the rest of the chunk is still in flight.
+        direct_.data->len = direct_.filled;
+        direct_.data->remaining = (ec || done) ? 0 : remainingHint();
+        direct_.data->recv_time = recv_time;
+        LOG_TRACE("<-- {}", std::string_view(direct_.data->data, direct_.filled));
+        if (auth_pending_) [[unlikely]]
+        {
+            checkAuthResponse(std::string_view(direct_.data->data, direct_.filled));
+        }
+        proxy_->publishWsData(direct_.index, direct_.size);
+        read_latency_.record(get_monotonic_ns() - recv_time);
+        direct_ = DirectChunk{};
+        chunked_ = !ec && !done;
 
-        LOG_TRACE("<-- {}", std::string((const char*)r_buffer_.data().data(), bytes_transferred));
-        proxy_->onWsData(id_, (const char*)r_buffer_.data().data(), bytes_transferred, 0);
-        // LOG_TRACE("{}: {}({}) bytes read", id_, bytes_transferred, r_buffer_.size());
-        r_buffer_.consume(bytes_transferred);
+        if (ec)
+        {
+            on_read(ec, bytes_transferred);
+            return;
+        }
 
+        if (chunked_ && startDirectRead())
+        {
+            return;
+        }
         if (status_.load(std::memory_order_relaxed) == Status::CONNECTED) {
-            // read next message
-            ws_.async_read(
-                r_buffer_,
-                beast::bind_front_handler(
-                    &Websocket::on_read,
-                    shared_from_this()));
+            read();
         }
     }
 
+    void read()
+    {
+        // never buffer more than a chunk
+        auto limit = max_chunk_size_ > r_buffer_.size() ? max_chunk_size_ - r_buffer_.size() : 1;
+        ws_->async_read_some(
+            r_buffer_,
+            limit,
+            beast::bind_front_handler(
+                &Websocket::on_read,
+                shared_from_this()));
+    }
+
     void on_close(beast::error_code ec)
     {
         if (ec && ec != beast::websocket::error::closed)
@@ -315,15 +739,101 @@ private:
         proxy_->onWsClosed(id_);
     }
 
+    // A read or write failed. Unless we are closing the connection, it dropped.
+    void connectionLost(beast::error_code ec, char const *what)
+    {
+        if (status_.load(std::memory_order_relaxed) != Status::CONNECTED || ec == asio::error::operation_aborted)
+        {
+            return;
+        }
+        if (!max_backoff_ms_)
+        {
+            if (ec != beast::websocket::error::closed && ec != asio::error::eof)
+            {
+                fail(ec, what);
+            }
+            return;
+        }
+
+        LOG_WARN("{} {}: {} {}, reconnecting", url_, what, ec.value(), ec.message());
+        status_.store(Status::RECONNECTING, std::memory_order_release);
+        // completes the pending operations, their handlers run before the first attempt.
+        // Writes still queued are sent once reconnected.
+        beast::error_code ignored;
+        beast::get_lowest_layer(*ws_).socket().close(ignored);
+        proxy_->onWsReconnecting(id_);
+        scheduleReconnect();
+    }
+
+    void scheduleReconnect()
+    {
+        // 50ms, 100ms, 200ms... up to max_backoff_ms_, with jitter so dropped websockets don't reconnect in lockstep
+        auto backoff = std::min<uint64_t>(uint64_t(50) << std::min<uint32_t>(reconnect_attempts_, 16), max_backoff_ms_);
+        backoff = backoff / 2 + (get_monotonic_ns() ^ id_) % (backoff / 2 + 1);
+        ++reconnect_attempts_;
+        reconnect_timer_.expires_after(std::chrono::milliseconds(backoff));
+        reconnect_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec && self->status_.load(std::memory_order_relaxed) == Status::RECONNECTING)
+            {
+                self->reconnect();
+            }
+        });
+    }
+
+    void reconnect()
+    {
+        LOG_INFO("Reconnecting {}, attempt {}", url_, reconnect_attempts_);
+        ws_.emplace(strand_, ctx_);
+        r_buffer_.clear();
+        chunked_ = false;
+        auto self = shared_from_this();
+        asio::spawn(
+            strand_,
+            std::bind(&Websocket::open, self, [self](bool success) {
+                if (!success)
+                {
+                    if (self->status_.load(std::memory_order_relaxed) == Status::CONNECTING)
+                    {
+                        self->status_.store(Status::RECONNECTING, std::memory_order_release);
+                        self->scheduleReconnect();
+                    }
+                    return;
+                }
+                self->reconnect_attempts_ = 0;
+                self->reconnects_.fetch_add(1, std::memory_order_relaxed);
+                self->proxy_->onWsReconnected(self->id_);
+            }, std::placeholders::_1),
+            [](std::exception_ptr ex) {
+                if (ex) {
+                    std::rethrow_exception(ex);
+                }
+            });
+    }
+
 private:
     void fail(beast::error_code ec, char const *what, std::function<void(bool)> *callback = nullptr, bool close_connection = true)
     {
+        if (callback && status_.load(std::memory_order_relaxed) == Status::DISCONNECTED)
+        {
+            // closed while connecting, see close()
+            (*callback)(false);
+            return;
+        }
         auto err_msg = ec.message();
+        if (callback && reconnect_attempts_)
+        {
+            // a failed reconnect attempt, clients already got the ReconnectWs notice and another attempt follows
+            LOG_WARN("{} {}: {} {}", url_, what, ec.value(), err_msg);
+            (*callback)(false);
+            return;
+        }
         LOG_ERROR("{}: {} {}", what, ec.value(), err_msg);
         proxy_->onWsError(id_, err_msg.c_str(), err_msg.size());
         if (callback)
         {
+            // failed to open, nothing to close. The caller decides whether to retry.
             (*callback)(false);
+            return;
         }
         if (close_connection && status_.load(std::memory_order_relaxed) < Status::DISCONNECTING)
         {
@@ -20,6 +20,7 @@
 // SOFTWARE.
 
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <thread>
 #include <string>
 #include <format>
@@ -28,6 +29,8 @@
 #include <boost/asio/spawn.hpp>
 #include "websocket_proxy.h"
 #include "websocket.h"
+#include <websocket_proxy/json_scanner.h>
+#include <websocket_proxy/market_data.h>
 
 using namespace websocket_proxy;
 
@@ -36,6 +39,39 @@ namespace {
 }
 
 namespace {
+    // Alpaca message type of a single message, e.g. {"T":"q","S":"AAPL",...}
+    SubscriptionType messageType(const char* data, uint32_t len)
+    {
+        auto type = json::findStringField(data, data + len, "\"T\"");
+        if (type == "q") {
+            return SubscriptionType::Quotes;
+        }
+        if (type == "t") {
+            return SubscriptionType::Trades;
+        }
+        return SubscriptionType::None;
+    }
+
+    // bytes of a request written back with its reply, the response fields are in the fixed part of the body
+    uint32_t replySize(Message::Type type)
+    {
+        switch (type) {
+        case Message::Type::Register:
+            return sizeof(RegisterMessage);
+        case Message::Type::OpenWs:
+            return sizeof(WsOpen);
+        case Message::Type::Subscribe:
+        case Message::Type::Unsubscribe:
+            return sizeof(WsSubscription);
+        case Message::Type::Stats:
+            return sizeof(StatsMessage);
+        case Message::Type::Auth:
+            return sizeof(WsAuth);
+        default:
+            return 0;
+        }
+    }
+
     std::string GetExePath()
     {
 #ifdef _WIN32
@@ -56,63 +92,46 @@ namespace {
     }
 }
 
-WebsocketProxy::WebsocketProxy(uint32_t server_queue_size)
-    : client_queue_(1 << 16, CLIENT_TO_SERVER_QUEUE)
-    , server_queue_(server_queue_size, SERVER_TO_CLIENT_QUEUE)
+WebsocketProxy::WebsocketProxy(const ProxyOptions& options)
+    : options_(options)
+    , client_queue_(kClientQueueSize, CLIENT_TO_SERVER_QUEUE)
+    , server_queue_(options.server_queue_size, SERVER_TO_CLIENT_QUEUE)
     , client_index_(client_queue_.initial_reading_index())
-    , pid_(GetCurrentProcessId())
+    , pid_(getCurrentProcessId())
     , exec_path_(GetExePath())
-    , closed_sockets_(256) {
-
-    // Get session-isolated name
-    DWORD session_id;
-    if (!ProcessIdToSessionId(pid_, &session_id)) {
-        throw std::runtime_error("Failed to get session ID. err=" + std::to_string(GetLastError()));
-    }
-
-#ifndef UNICODE
-    std::string shmName = "Local\\WebsocketProxy_" + std::to_string(session_id) + "_owner";
-#else
-    std::wstring shmName = L"Local\\WebsocketProxy_" + std::to_wstring(session_id) + L"_owner";
-#endif
-
-    // Create a security descriptor that allows access only to current user
-    SECURITY_ATTRIBUTES sa;
-    SECURITY_DESCRIPTOR sd;
-    InitializeSecurityDescriptor(&sd, SECURITY_DESCRIPTOR_REVISION);
-    SetSecurityDescriptorDacl(&sd, TRUE, NULL, FALSE); // Allow current user only
-    sa.nLength = sizeof(sa);
-    sa.lpSecurityDescriptor = &sd;
-    sa.bInheritHandle = FALSE;
-
-    hMapFile_ = CreateFileMapping(
-        INVALID_HANDLE_VALUE,   // use paging file
-        &sa,                    // default security
-        PAGE_READWRITE,         // read/write access
-        0,                      // maximum object size (high-order DWORD)f
-        sizeof(DWORD),          // maximum object size (low-order DWORD)
-        shmName.c_str()         // name of mapping object
-    );
-
-    if (hMapFile_ == NULL) {
-        auto err = GetLastError();
-        throw std::runtime_error(std::format("Failed to create shm. err={}", err));
-    }
-
-    if (GetLastError() != ERROR_ALREADY_EXISTS) {
-        own_shm_ = true;
+    , closed_sockets_(256)
+    , control_queue_(kControlQueueSize) {
+    control_queue_index_ = control_queue_.initial_reading_index();
+    control_queue_cursor_.store(control_queue_index_, std::memory_order_relaxed);
+    // without routing every part would go to every client, more traffic rather than less
+    if ((options_.split_frames && options_.route_by_symbol) || options_.binary_market_data) {
+        splitter_ = std::make_unique<JsonArraySplitter>(options_.binary_market_data);
     }
+    auto queue_size = options_.route_by_symbol ? std::min(options_.server_queue_size, options_.client_queue_size) : options_.server_queue_size;
+    // a small queue still takes 1KB chunks, the bounds of std::clamp must be ordered
+    max_chunk_size_ = std::clamp(options_.max_chunk_size, 1024u, std::max(1024u, queue_size / 4));
 
-    lpvMem_ = MapViewOfFile(hMapFile_, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(DWORD));
-    if (!lpvMem_) {
-        throw std::runtime_error("Failed to create shm. err=" + std::to_string(GetLastError()));
+    // Get session-isolated name
+    auto shm_name = std::format("WebsocketProxy_{}_owner", getSessionId());
+    owner_shm_ = std::make_unique<SharedMemory>(shm_name, sizeof(std::atomic<uint64_t>));
+    own_shm_ = owner_shm_->created();
+    if (!own_shm_) {
+        // Left behind by a proxy that crashed, nobody would unlink it. 0 is a proxy that has just created it.
+        auto owner = reinterpret_cast<std::atomic<uint64_t>*>(owner_shm_->data())->load(std::memory_order_relaxed);
+        if (owner && !isProcessRunning(owner)) {
+            LOG_INFO("Removing stale owner segment {}, PID={}", shm_name, owner);
+            owner_shm_.reset();
+            SharedMemory::remove(shm_name);
+            owner_shm_ = std::make_unique<SharedMemory>(shm_name, sizeof(std::atomic<uint64_t>));
+            own_shm_ = owner_shm_->created();
+        }
     }
 
     if (own_shm_) {
-        owner_pid_ = new (lpvMem_) std::atomic<uint64_t>(pid_);
+        owner_pid_ = new (owner_shm_->data()) std::atomic<uint64_t>(pid_);
     }
     else {
-        owner_pid_ = reinterpret_cast<std::atomic<uint64_t>*>(lpvMem_);
+        owner_pid_ = reinterpret_cast<std::atomic<uint64_t>*>(owner_shm_->data());
     }
 }
 
@@ -121,17 +140,12 @@ WebsocketProxy::~WebsocketProxy() {
     {
         shutdown();
     }
-    if (lpvMem_) {
+    if (owner_shm_) {
         if (own_shm_) {
             owner_pid_->store(0, std::memory_order_release);
         }
-        UnmapViewOfFile(lpvMem_);
-        lpvMem_ = nullptr;
-    }
-
-    if (hMapFile_) {
-        CloseHandle(hMapFile_);
-        hMapFile_ = nullptr;
+        owner_pid_ = nullptr;
+        owner_shm_.reset();
     }
 }
 
@@ -156,11 +170,22 @@ void WebsocketProxy::run() {
 
         LOG_INFO("The other WebsocketProxy instance is dead, taking over ownership");
     }
+    client_notifier_ = std::make_unique<Notifier>(CLIENT_TO_SERVER_NOTIFIER, true);
+    if (options_.client_spin_us >= 0) {
+        // the reader thread blocks once idle, clients notify it
+        client_notifier_->registerWaiter();
+    }
+    server_notifier_ = std::make_unique<Notifier>(SERVER_TO_CLIENT_NOTIFIER, true);
+    // prefaulting writes to the queues, never while another instance may be using them
+    placeQueue(CLIENT_TO_SERVER_QUEUE, client_queue_, kClientQueueSize);
+    placeQueue(SERVER_TO_CLIENT_QUEUE, server_queue_, options_.server_queue_size);
 
     boost::asio::signal_set signals(ioc_, SIGINT, SIGTERM);
     signals.async_wait([&](auto, auto){ shutdown(); });
 
     LOG_INFO("\n\nWebsocketProxy started. PID={}\n", pid_);
+    openStatsSegment();
+    openClientStatusSegment();
 
     // start heartbeat
     ioc_.post([this]() {
@@ -168,12 +193,15 @@ void WebsocketProxy::run() {
         // server is up running
         auto now = get_timestamp();
         sendHeartbeat(now);
+        last_stats_time_ = now;
         
-        startHeartbeat(); 
+        startHousekeeping(); 
     });
     
+    startIoWorkers();
+
     // start process incoming client messages
-    ioc_.post([this]() { processClientMessage(); });
+    client_reader_ = std::thread([this]() { readClientMessages(); });
 
     while (run_.load(std::memory_order_relaxed))
     {
@@ -199,6 +227,11 @@ void WebsocketProxy::run() {
         LOG_TRACE("call ioc_.stop at the end of run");
         ioc_.stop();
     }
+    if (client_reader_.joinable()) {
+        client_reader_.join();
+    }
+    stopIoWorkers();
+    logLatencyStats();
     LOG_INFO("WebsocketProxy Exit. PID={}", pid_);
 }
 
@@ -227,33 +260,310 @@ void WebsocketProxy::shutdown()
     });
 }
 
-void WebsocketProxy::startHeartbeat() {
+void WebsocketProxy::startHousekeeping() {
     checkHeartbeats();
-    if (run_.load(std::memory_order_relaxed)) {
-        ioc_.post([this]() { startHeartbeat(); });
+    removeClosedSockets();
+
+    auto now = get_timestamp();
+    checkStalledClients(now);
+    checkAuthTimeouts(now);
+    if (now - last_stats_time_ >= 60000) {
+        last_stats_time_ = now;
+        logLatencyStats();
+    }
+    if (now - last_stats_update_time_ >= PROXY_STATS_INTERVAL) {
+        last_stats_update_time_ = now;
+        updateStatsSegment(now);
+    }
+
+    if (run_.load(std::memory_order_relaxed)) [[likely]] {
+        if (shutdown_time_ && (now - shutdown_time_) >= 60000) {
+            shutdown();
+        }
+        else {
+            housekeeping_timer_.expires_after(std::chrono::milliseconds(HEARTBEAT_INTERVAL / 5));
+            housekeeping_timer_.async_wait([this](const boost::system::error_code& ec) {
+                if (!ec) {
+                    startHousekeeping();
+                }
+            });
+        }
     }
 }
 
-void WebsocketProxy::processClientMessage() {
-    auto req = client_queue_.read(client_index_);
-    if (req.first) [[unlikely]] {
-        handleClientMessage(reinterpret_cast<Message&>(*req.first));
+void WebsocketProxy::readClientMessages() {
+    // Client requests are read on this thread and handled on the control thread.
+    // Spin for a short while after the last message, then block until a client publishes.
+    auto spin_ns = options_.client_spin_us * 1000;
+    auto idle_since = get_monotonic_ns();
+    bool blocked = false;
+    while (run_.load(std::memory_order_relaxed)) {
+        uint32_t n = 0;
+        std::pair<uint8_t*, size_t> req;
+        while ((req = client_queue_.read(client_index_)).first) {
+            // read() moved client_index_ just past the request
+            auto size = static_cast<uint32_t>(req.second);
+            uint64_t request_index = client_index_ - size;
+            // don't overwrite entries the control thread hasn't handled yet, an entry may also
+            // be skipped to the start of the queue when it doesn't fit before the end
+            auto entry_size = sizeof(request_index) + size;
+            while (control_queue_.initial_reading_index() + 2 * entry_size - control_queue_cursor_.load(std::memory_order_acquire) > kControlQueueSize) {
+                if (!run_.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            auto index = control_queue_.reserve(entry_size);
+            auto entry = control_queue_[index];
+            memcpy(entry, &request_index, sizeof(request_index));
+            memcpy(entry + sizeof(request_index), req.first, size);
+            control_queue_.publish(index, entry_size);
+            ++n;
+        }
+        if (n) {
+            client_queue_cursor_.store(client_index_, std::memory_order_relaxed);
+        }
+
+        if (n) {
+            (blocked ? blocking_wakeups_ : spin_wakeups_).fetch_add(1, std::memory_order_relaxed);
+            blocked = false;
+            if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+                ioc_.post([this]() { drainClientMessages(); });
+            }
+            idle_since = get_monotonic_ns();
+            continue;
+        }
+
+        if (spin_ns < 0 || (get_monotonic_ns() - idle_since) < static_cast<uint64_t>(spin_ns)) {
+            cpu_relax();
+            continue;
+        }
+
+        // timed out periodically to observe shutdown
+        client_notifier_->wait([this]() {
+            auto index = client_index_;
+            return client_queue_.read(index).first != nullptr;
+        }, 100);
+        blocked = true;
     }
+}
 
-    removeClosedSockets();
+void WebsocketProxy::startIoWorkers() {
+    for (uint32_t i = 0; i < options_.io_threads; ++i) {
+        auto worker = std::make_unique<IoWorker>();
+        worker->thread = std::thread([ioc = &worker->ioc, i]() {
+            LOG_INFO("io worker {} started", i);
+            while (!ioc->stopped()) {
+                try {
+                    ioc->run();
+                }
+                catch (const std::exception& e) {
+                    LOG_ERROR("io worker {}: {}", i, e.what());
+                }
+            }
+            LOG_INFO("io worker {} stopped", i);
+        });
+        io_workers_.emplace_back(std::move(worker));
+    }
+}
 
-    if (run_.load(std::memory_order_relaxed)) [[likely]] {
-        if (shutdown_time_ && (get_timestamp() - shutdown_time_) >= 60000) {
-            shutdown();
+void WebsocketProxy::stopIoWorkers() {
+    for (auto& worker : io_workers_) {
+        worker->work.reset();
+        worker->ioc.stop();
+    }
+    for (auto& worker : io_workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
         }
-        else
-        {
-            ioc_.post([this]() { processClientMessage(); });
+    }
+    io_workers_.clear();
+}
+
+asio::io_context& WebsocketProxy::nextIoContext() {
+    if (io_workers_.empty()) {
+        return ioc_;
+    }
+    return io_workers_[next_io_worker_++ % io_workers_.size()]->ioc;
+}
+
+void WebsocketProxy::logLatencyStats() {
+    if (request_latency_.count()) {
+        LOG_INFO("Client request latency: {}, spin_wakeups={}, blocking_wakeups={}", request_latency_.summary(),
+            spin_wakeups_.load(std::memory_order_relaxed), blocking_wakeups_.load(std::memory_order_relaxed));
+    }
+    for (auto& kvp : websocketsById_) {
+        auto& websocket = kvp.second;
+        if (websocket->writeLatency().count()) {
+            LOG_INFO("Websocket {} write latency: {}, frames={}, merged={}, queued_bytes={}", kvp.first, websocket->writeLatency().summary(),
+                websocket->framesWritten(), websocket->messagesMerged(), websocket->queuedBytes());
+        }
+        if (websocket->readLatency().count()) {
+            LOG_INFO("Websocket {} read latency: {}", kvp.first, websocket->readLatency().summary());
+        }
+    }
+}
+
+void WebsocketProxy::openStatsSegment() {
+    // A segment left by a proxy that died is unlinked rather than reused, so this one is unlinked on exit.
+    // Readers still mapping the old one keep its last snapshot.
+    SharedMemory::remove(proxyStatsName());
+    try {
+        stats_shm_ = std::make_unique<SharedMemory>(proxyStatsName(), sizeof(ProxyStats));
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("Failed to open the stats segment. err={}", e.what());
+        return;
+    }
+    memset(stats_shm_->data(), 0, sizeof(ProxyStats));
+    stats_ = new (stats_shm_->data()) ProxyStats();
+    stats_->version = PROXY_STATS_VERSION;
+    stats_->pid = pid_;
+    LOG_INFO("Stats segment {}, {} bytes", proxyStatsName(), sizeof(ProxyStats));
+}
+
+void WebsocketProxy::openClientStatusSegment() {
+    // like the stats segment, one left by a proxy that died is unlinked
+    SharedMemory::remove(CLIENT_STATUS_SEGMENT);
+    try {
+        client_status_shm_ = std::make_unique<SharedMemory>(CLIENT_STATUS_SEGMENT, sizeof(ClientStatus) * kMaxClients);
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("Failed to open the client status segment. err={}", e.what());
+        return;
+    }
+    memset(client_status_shm_->data(), 0, sizeof(ClientStatus) * kMaxClients);
+    client_status_ = new (client_status_shm_->data()) ClientStatus[kMaxClients]();
+}
+
+void WebsocketProxy::updateStatsSegment(uint64_t now) {
+    if (!stats_) {
+        return;
+    }
+    // seqlock, readers retry while seq is odd or changed during their copy
+    auto seq = stats_->seq.load(std::memory_order_relaxed);
+    stats_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    stats_->update_time = now;
+
+    auto server_head = server_queue_.initial_reading_index();
+    uint64_t slowest = 0;
+    uint32_t n = 0;
+    for (auto& [pid, client] : clients_) {
+        if (n == kMaxStatsClients) {
+            break;
         }
+        auto& out = stats_->clients[n++];
+        memset(&out, 0, sizeof(out));
+        out.pid = pid;
+        strncpy(out.name, client.name.c_str(), sizeof(out.name) - 1);
+        out.slot = client.slot;
+        out.last_heartbeat_time = client.last_heartbeat_time;
+        out.messages_consumed = client.messages_consumed;
+        out.server_queue_lag = client.server_queue_lag;
+        out.data_queue_lag = client.data_queue_lag;
+        out.overruns = client.overruns;
+        slowest = std::max(slowest, client.server_queue_lag);
     }
+    stats_->client_count = n;
+    stats_->server_queue = QueueStats{ options_.server_queue_size, server_head, std::min<uint64_t>(slowest, options_.server_queue_size) };
+
+    auto client_head = client_queue_.initial_reading_index();
+    auto client_cursor = std::min(client_queue_cursor_.load(std::memory_order_relaxed), client_head);
+    stats_->client_queue = QueueStats{ kClientQueueSize, client_head, std::min<uint64_t>(client_head - client_cursor, kClientQueueSize) };
+
+    n = 0;
+    for (auto& [id, websocket] : websocketsById_) {
+        if (n == kMaxStatsWebsockets) {
+            break;
+        }
+        auto& out = stats_->websockets[n++];
+        memset(&out, 0, sizeof(out));
+        out.id = id;
+        strncpy(out.url, websocket->url_.c_str(), sizeof(out.url) - 1);
+        out.status = websocket->status();
+        out.clients = static_cast<uint32_t>(websocket->clients().size());
+        out.frames_read = websocket->framesRead();
+        out.bytes_read = websocket->bytesRead();
+        out.frames_written = websocket->framesWritten();
+        out.bytes_written = websocket->bytesWritten();
+        out.reconnects = websocket->reconnects();
+        out.write_queue_depth = websocket->queuedMessages();
+        out.write_queue_bytes = websocket->queuedBytes();
+    }
+    stats_->websocket_count = n;
+
+    stats_->seq.store(seq + 2, std::memory_order_release);
 }
 
-void WebsocketProxy::handleClientMessage(Message& msg) {
+void WebsocketProxy::drainClientMessages() {
+    // cleared first, so a request published after the last read below schedules another drain
+    drain_scheduled_.store(false, std::memory_order_release);
+
+    auto batch_size = std::max<uint32_t>(options_.client_batch_size, 1);
+    auto now = get_monotonic_ns();
+    uint32_t n = 0;
+    std::pair<uint8_t*, size_t> read;
+    while (n < batch_size && (read = control_queue_.read(control_queue_index_)).first) {
+        ++n;
+        auto& msg = *reinterpret_cast<Message*>(read.first + sizeof(uint64_t));
+        RequestRef ref{ 0, msg.pid, msg.timestamp };
+        memcpy(&ref.index, read.first, sizeof(ref.index));
+        request_latency_.record(now - msg.timestamp);
+        if (msg.type == Message::Type::Subscribe) {
+            auto id = reinterpret_cast<WsSubscription*>(msg.data)->id;
+            if (id != subscribe_merger_ws_) {
+                flushSubscribes();
+                subscribe_merger_ws_ = id;
+            }
+            handleSubscribe(msg, true);
+        }
+        else {
+            flushSubscribes();
+            handleClientMessage(ref, msg);
+        }
+
+        // the copy was answered, requests completing later reply themselves, e.g. openNewWs
+        auto status = msg.status.load(std::memory_order_relaxed);
+        if (status != Message::Status::PENDING) {
+            replyToClient(ref, status, [&msg](Message& request) { memcpy(request.data, msg.data, replySize(msg.type)); });
+        }
+        // the entry may be reused by the reader thread from here
+        control_queue_cursor_.store(control_queue_index_, std::memory_order_release);
+    }
+    flushSubscribes();
+    // responses are written into the requests, wake clients blocked in waitForResponse
+    server_notifier_->notify();
+
+    if (n == batch_size && !drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        // more requests pending, let the socket handlers run in between
+        ioc_.post([this]() { drainClientMessages(); });
+    }
+}
+
+Message* WebsocketProxy::requestAt(const RequestRef& ref) {
+    // Half the queue behind the head, the client gave up on the request long ago. The margin keeps
+    // clients publishing meanwhile from reaching the request before the reply is written.
+    if (client_queue_.initial_reading_index() - ref.index > kClientQueueSize / 2) {
+        return nullptr;
+    }
+    auto msg = reinterpret_cast<Message*>(client_queue_[ref.index]);
+    return (msg->pid == ref.pid && msg->timestamp == ref.timestamp) ? msg : nullptr;
+}
+
+template<typename Fill>
+void WebsocketProxy::replyToClient(const RequestRef& ref, Message::Status status, Fill&& fill) {
+    auto msg = requestAt(ref);
+    if (!msg) {
+        LOG_WARN("Request of client {} overwritten before its reply", ref.pid);
+        return;
+    }
+    fill(*msg);
+    msg->status.store(status, std::memory_order_release);
+}
+
+void WebsocketProxy::handleClientMessage(const RequestRef& ref, Message& msg) {
     switch (msg.type) {
     case Message::Type::Register:
         handleClientRegistration(msg);
@@ -265,7 +575,7 @@ void WebsocketProxy::handleClientMessage(Message& msg) {
         handleClientHeartbeat(msg);
         break;
     case Message::Type::OpenWs:
-        openWs(msg);
+        openWs(ref, msg);
         break;
     case Message::Type::CloseWs:
         closeWs(msg);
@@ -282,6 +592,12 @@ void WebsocketProxy::handleClientMessage(Message& msg) {
     case Message::Type::LogLevel:
         slick_logger::Logger::instance().set_level(static_cast<slick_logger::LogLevel>(reinterpret_cast<LogLevel*>(msg.data)->level));
         break;
+    case Message::Type::Stats:
+        handleStats(msg);
+        break;
+    case Message::Type::Auth:
+        handleAuth(ref, msg);
+        break;
     case Message::Type::WsData:
     case Message::Type::WsError:
         break;
@@ -308,10 +624,44 @@ void WebsocketProxy::handleClientRegistration(Message& msg) {
 
     auto it = clients_.find(msg.pid);
     if (it == clients_.end()) {
-        it = clients_.emplace(msg.pid, ClientInfo()).first;
+        auto slot = used_client_slots_.firstUnset();
+        if (slot == kMaxClients) {
+            LOG_ERROR("Failed to register client {}. Too many clients", msg.pid);
+            snprintf(reg->err, sizeof(reg->err), "Too many clients, max %u", kMaxClients);
+            msg.status.store(Message::Status::FAILED, std::memory_order_release);
+            return;
+        }
+        used_client_slots_.set(slot);
+        it = clients_.try_emplace(msg.pid).first;
+        it->second.pid = msg.pid;
+        it->second.slot = slot;
+        it->second.name.assign(reg->name, strnlen(reg->name, sizeof(reg->name)));
     }
-    it->second.pid = msg.pid;
     it->second.last_heartbeat_time = get_timestamp();
+    reg->slot = it->second.slot;
+    reg->binary_market_data = options_.binary_market_data;
+
+    if (options_.route_by_symbol) {
+        auto queue_name = std::format("{}{}", CLIENT_DATA_QUEUE_PREFIX, msg.pid);
+        auto& data_queue = client_data_queues_[msg.pid];
+        if (!data_queue) {
+            try {
+                data_queue = std::make_unique<SHM_QUEUE_T>(options_.client_queue_size, queue_name.c_str());
+                placeQueue(queue_name.c_str(), *data_queue, options_.client_queue_size);
+            }
+            catch (const std::exception& e) {
+                LOG_ERROR("Failed to create data queue {}. err={}", queue_name, e.what());
+                snprintf(reg->err, sizeof(reg->err), "Failed to create data queue %s", queue_name.c_str());
+                client_data_queues_.erase(msg.pid);
+                used_client_slots_.reset(it->second.slot);
+                clients_.erase(it);
+                msg.status.store(Message::Status::FAILED, std::memory_order_release);
+                return;
+            }
+        }
+        client_slot_queues_[it->second.slot].store(data_queue.get(), std::memory_order_release);
+        strncpy(reg->data_queue, queue_name.c_str(), sizeof(reg->data_queue) - 1);
+    }
     msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
 }
 
@@ -319,6 +669,7 @@ void WebsocketProxy::unregisterClient(uint64_t pid) {
     auto it = clients_.find(pid);
     if (it != clients_.end()) {
         LOG_INFO("Unregister client {}", pid);
+        clearClientSubscriptions(it->second);
         std::vector<uint64_t> to_close;
         to_close.reserve(websocketsById_.size());
         for (auto& kvp : websocketsById_) {
@@ -334,6 +685,7 @@ void WebsocketProxy::unregisterClient(uint64_t pid) {
         for (auto id : to_close) {
             closeWs(id, pid);
         }
+        releaseClientSlot(it->second);
         clients_.erase(it);
 
         if (clients_.empty()) {
@@ -345,6 +697,7 @@ void WebsocketProxy::unregisterClient(uint64_t pid) {
 
 void WebsocketProxy::unregisterClient(std::unordered_map<uint64_t, ClientInfo>::iterator &iter) {
     LOG_INFO("Unregister client {}", iter->first);
+    clearClientSubscriptions(iter->second);
     std::vector<uint64_t> to_close;
     to_close.reserve(websocketsById_.size());
     for (auto& kvp : websocketsById_) {
@@ -361,6 +714,7 @@ void WebsocketProxy::unregisterClient(std::unordered_map<uint64_t, ClientInfo>::
     for (auto id : to_close) {
         closeWs(id, iter->first);
     }
+    releaseClientSlot(iter->second);
     iter = clients_.erase(iter);
 
     if (clients_.empty()) {
@@ -369,11 +723,291 @@ void WebsocketProxy::unregisterClient(std::unordered_map<uint64_t, ClientInfo>::
     }
 }
 
+void WebsocketProxy::clearClientSubscriptions(const ClientInfo& client) {
+    // Before its websockets are closed and dropped from websocketsById_. A closing websocket keeps
+    // routing until it is closed, its table must not hold the slot once a new client gets it.
+    for (auto& kvp : websocketsById_) {
+        kvp.second->subscriptions_.removeClient(client.slot);
+    }
+}
+
+void WebsocketProxy::placeQueue(const char* name, SHM_QUEUE_T& queue, uint32_t size) {
+    // queue[0] is the start of the data buffer, nothing has been written to it yet
+    auto data = queue[0];
+    applyShmPlacement(name, data, size, options_.shm_placement);
+    auto report = queryShmPlacement(data, size);
+    LOG_INFO("{}: {} KB, page_size={} KB, huge_pages={} KB, resident={} KB, numa_node={}", name, report.bytes >> 10,
+        report.page_size >> 10, report.huge_bytes >> 10, report.resident_bytes >> 10, report.numa_node);
+}
+
+void WebsocketProxy::releaseClientSlot(const ClientInfo& client) {
+    client_slot_queues_[client.slot].store(nullptr, std::memory_order_release);
+    auto it = client_data_queues_.find(client.pid);
+    if (it != client_data_queues_.end()) {
+        retireClientDataQueue(std::move(it->second));
+        client_data_queues_.erase(it);
+    }
+    used_client_slots_.reset(client.slot);
+}
+
+void WebsocketProxy::retireClientDataQueue(std::unique_ptr<SHM_QUEUE_T> queue) {
+    if (io_workers_.empty()) {
+        // routing runs on this thread, nothing else can hold the queue
+        return;
+    }
+    // An io thread may still be publishing to the queue. Once a handler posted after the
+    // slot was cleared has run on every io thread, none of them can see the queue anymore.
+    struct Retired {
+        std::unique_ptr<SHM_QUEUE_T> queue;
+        std::atomic<uint32_t> pending;
+    };
+    auto retired = std::make_shared<Retired>(std::move(queue), static_cast<uint32_t>(io_workers_.size()));
+    for (auto& worker : io_workers_) {
+        worker->ioc.post([retired]() {
+            if (retired->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                retired->queue.reset();
+            }
+        });
+    }
+}
+
 void WebsocketProxy::handleClientHeartbeat(Message& msg) {
-    getClient(msg.pid);
+    auto client = getClient(msg.pid);
+    if (client) {
+        auto heartbeat = reinterpret_cast<HeartbeatMessage*>(msg.data);
+        client->server_queue_cursor = heartbeat->server_queue_cursor;
+        client->data_queue_cursor = heartbeat->data_queue_cursor;
+        client->messages_consumed = heartbeat->messages_consumed;
+        client->cursor_time = get_timestamp();
+        // against the heads now, the cursors were read by the client just before sending
+        updateClientLag(*client);
+        if (!checkClientLag(*client)) {
+            unregisterClient(msg.pid);
+        }
+    }
+}
+
+void WebsocketProxy::updateClientLag(ClientInfo& client) {
+    auto server_head = server_queue_.initial_reading_index();
+    client.server_queue_lag = server_head > client.server_queue_cursor ? server_head - client.server_queue_cursor : 0;
+    auto it = client_data_queues_.find(client.pid);
+    if (it != client_data_queues_.end()) {
+        auto data_head = it->second->initial_reading_index();
+        client.data_queue_lag = data_head > client.data_queue_cursor ? data_head - client.data_queue_cursor : 0;
+    }
+}
+
+bool WebsocketProxy::checkClientLag(ClientInfo& client) {
+    // returns false if the client is over the lag budget and has to be unregistered
+    bool data_queue = client.data_queue_lag > client.server_queue_lag;
+    auto lag = std::max(client.server_queue_lag, client.data_queue_lag);
+    if (options_.max_client_lag && lag > options_.max_client_lag) {
+        LOG_WARN("Client {} {} lag {} bytes over budget {}, disconnecting", client.pid, client.name, lag, options_.max_client_lag);
+        sendOverrun(client, data_queue, true);
+        return false;
+    }
+
+    bool overrun = client.server_queue_lag > options_.server_queue_size ||
+        (options_.route_by_symbol && client.data_queue_lag > options_.client_queue_size);
+    if (!overrun) {
+        client.overrun_notified = false;
+    }
+    else if (!client.overrun_notified) {
+        // once until it catches up again
+        client.overrun_notified = true;
+        ++client.overruns;
+        LOG_WARN("Client {} {} overrun, lag {} bytes", client.pid, client.name, lag);
+        sendOverrun(client, data_queue, false);
+    }
+    return true;
+}
+
+void WebsocketProxy::checkStalledClients(uint64_t now) {
+    // A client stuck in a callback stops sending heartbeats long before the heartbeat timeout.
+    // Its cursors haven't moved since, so its lag grows with the queue heads.
+    std::vector<uint64_t> to_disconnect;
+    for (auto& [pid, client] : clients_) {
+        if (client.cursor_time && (now - client.cursor_time) > 2 * HEARTBEAT_INTERVAL) {
+            updateClientLag(client);
+            if (!checkClientLag(client)) {
+                to_disconnect.push_back(pid);
+            }
+        }
+    }
+    for (auto pid : to_disconnect) {
+        unregisterClient(pid);
+    }
+}
+
+void WebsocketProxy::sendOverrun(const ClientInfo& client, bool data_queue, bool disconnected) {
+    // out of band, the queues are what the client is behind on
+    if (!client_status_) {
+        return;
+    }
+    auto& status = client_status_[client.slot];
+    auto seq = status.seq.load(std::memory_order_relaxed);
+    status.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    status.overrun.client_pid = client.pid;
+    status.overrun.data_queue = data_queue;
+    status.overrun.lag = data_queue ? client.data_queue_lag : client.server_queue_lag;
+    status.overrun.queue_size = data_queue ? options_.client_queue_size : options_.server_queue_size;
+    status.overrun.disconnected = disconnected;
+    status.seq.store(seq + 2, std::memory_order_release);
+    server_notifier_->notify();
+}
+
+void WebsocketProxy::handleAuth(const RequestRef& ref, Message& msg) {
+    // The first client sends the request upstream, clients asking meanwhile wait for the same reply.
+    // Once authenticated, clients are answered with the cached reply.
+    auto req = reinterpret_cast<WsAuth*>(msg.data);
+    auto client = getClient(msg.pid);
+    auto it = client ? websocketsById_.find(req->id) : websocketsById_.end();
+    if (it == websocketsById_.end()) {
+        auto err = client ? std::format("Websocket not found. id={}", req->id) : std::format("Client {} not found", msg.pid);
+        answerAuth(ref, false, err);
+        return;
+    }
+
+    auto& websocket = *it->second;
+    switch (websocket.auth_state_) {
+    case Websocket::AuthState::Authenticated:
+        LOG_DEBUG("Ws {} already authenticated, client={}", req->id, msg.pid);
+        answerAuth(ref, true, websocket.auth_response_);
+        break;
+    case Websocket::AuthState::Pending:
+        websocket.auth_waiting_.push_back(ref);
+        break;
+    case Websocket::AuthState::TimedOut:
+        // a second request on the same connection would be rejected as already authenticated, wait for the first's reply again
+        LOG_INFO("Ws {} still waiting for the authentication reply, client={}", req->id, msg.pid);
+        websocket.auth_state_ = Websocket::AuthState::Pending;
+        websocket.auth_start_time_ = get_timestamp();
+        websocket.auth_waiting_.push_back(ref);
+        break;
+    case Websocket::AuthState::None:
+        LOG_INFO("Authenticating ws {}, client={}", req->id, msg.pid);
+        websocket.auth_state_ = Websocket::AuthState::Pending;
+        websocket.auth_start_time_ = get_timestamp();
+        websocket.auth_waiting_.push_back(ref);
+        websocket.has_auth_request_ = true;
+        websocket.authenticate(std::string(req->request, req->request_len),
+            std::string(req->success, strnlen(req->success, sizeof(req->success))),
+            std::string(req->failure, strnlen(req->failure, sizeof(req->failure))));
+        break;
+    }
+}
+
+void WebsocketProxy::answerAuth(const RequestRef& ref, bool success, std::string_view response) {
+    replyToClient(ref, success ? Message::Status::SUCCESS : Message::Status::FAILED, [response](Message& msg) {
+        auto req = reinterpret_cast<WsAuth*>(msg.data);
+        req->response_len = static_cast<uint32_t>(std::min(response.size(), sizeof(req->response)));
+        memcpy(req->response, response.data(), req->response_len);
+    });
+    server_notifier_->notify();
+}
+
+void WebsocketProxy::completeAuth(Websocket& websocket, bool success, std::string_view response) {
+    if (websocket.auth_state_ != Websocket::AuthState::Pending && websocket.auth_state_ != Websocket::AuthState::TimedOut) {
+        return;
+    }
+    if (success) {
+        LOG_INFO("Ws {} authenticated", websocket.id());
+        websocket.auth_state_ = Websocket::AuthState::Authenticated;
+        websocket.auth_response_ = response;
+    }
+    else {
+        LOG_ERROR("Ws {} authentication failed: {}", websocket.id(), response);
+        websocket.auth_state_ = Websocket::AuthState::None;
+    }
+    for (auto& ref : websocket.auth_waiting_) {
+        answerAuth(ref, success, response);
+    }
+    websocket.auth_waiting_.clear();
+
+    if (websocket.replay_after_auth_) {
+        if (success) {
+            websocket.replay_after_auth_ = false;
+            completeReconnect(websocket);
+        }
+        else {
+            // replayed once a client authenticates successfully
+            reportReplayBlocked(websocket, response);
+        }
+    }
+}
+
+void WebsocketProxy::checkAuthTimeouts(uint64_t now) {
+    for (auto& [id, websocket] : websocketsById_) {
+        if (websocket->auth_state_ == Websocket::AuthState::Pending && (now - websocket->auth_start_time_) > AUTH_TIMEOUT) {
+            // a late reply still completes the authentication
+            LOG_WARN("Ws {} authentication timed out", id);
+            websocket->auth_state_ = Websocket::AuthState::TimedOut;
+            for (auto& ref : websocket->auth_waiting_) {
+                answerAuth(ref, false, "Authentication timed out");
+            }
+            websocket->auth_waiting_.clear();
+            if (websocket->replay_after_auth_) {
+                reportReplayBlocked(*websocket, "Authentication timed out");
+            }
+        }
+    }
+}
+
+void WebsocketProxy::reportReplayBlocked(Websocket& websocket, std::string_view reason) {
+    // subscriptions aren't replayed on an unauthenticated connection
+    auto err = std::format("Authentication failed after reconnecting, subscriptions not replayed: {}", reason);
+    LOG_ERROR("Ws {} {}", websocket.id(), err);
+    onWsError(websocket.id(), err.c_str(), static_cast<uint32_t>(err.size()));
+}
+
+void WebsocketProxy::handleStats(Message& msg) {
+    auto stats = reinterpret_cast<StatsMessage*>(msg.data);
+    auto client = getClient(msg.pid);
+    if (!client) {
+        msg.status.store(Message::Status::FAILED, std::memory_order_release);
+        return;
+    }
+    if (stats->queue_residency.count) {
+        client->queue_residency = stats->queue_residency;
+    }
+    if (stats->callback.count) {
+        client->callback = stats->callback;
+    }
+    if (!stats->reply) {
+        // a periodic report, nobody waits for the status
+        return;
+    }
+
+    LatencyHistogram read;
+    LatencyHistogram write;
+    for (auto& kvp : websocketsById_) {
+        read.merge(kvp.second->readLatency());
+        write.merge(kvp.second->writeLatency());
+        if (stats->reset) {
+            kvp.second->resetLatency();
+        }
+    }
+    stats->request = request_latency_.stats();
+    stats->read = read.stats();
+    stats->write = write.stats();
+    stats->client_queue_residency = {};
+    stats->client_callback = {};
+    stats->clients = 0;
+    for (auto& kvp : clients_) {
+        if (kvp.second.queue_residency.count || kvp.second.callback.count) {
+            stats->client_queue_residency.worst(kvp.second.queue_residency);
+            stats->client_callback.worst(kvp.second.callback);
+            ++stats->clients;
+        }
+    }
+    if (stats->reset) {
+        request_latency_.reset();
+    }
+    msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
 }
 
-void WebsocketProxy::openWs(Message& msg) {
+void WebsocketProxy::openWs(const RequestRef& ref, Message& msg) {
     auto req = reinterpret_cast<WsOpen*>(msg.data);
     auto client = getClient(msg.pid);
     if (client) {
@@ -394,7 +1028,7 @@ void WebsocketProxy::openWs(Message& msg) {
             }
         }
         
-        openNewWs(msg, req);
+        openNewWs(ref, msg, req);
     }
     else {
         snprintf(req->err, 256, "Client %llu not found", msg.pid);
@@ -402,27 +1036,35 @@ void WebsocketProxy::openWs(Message& msg) {
     }
 }
 
-void WebsocketProxy::openNewWs(Message& msg, WsOpen* req) {
+void WebsocketProxy::openNewWs(const RequestRef& ref, Message& msg, WsOpen* req) {
     LOG_INFO("Opening ws {}, clinet={}", req->url, msg.pid);
     req->new_connection = true;
-    auto websocket = std::make_shared<Websocket>(this, ioc_, ctx_, pid_ * 10000 + (++websocket_id_), req->url, req->api_key);
+    auto websocket = std::make_shared<Websocket>(this, nextIoContext(), ctx_, pid_ * 10000 + (++websocket_id_), req->url, req->api_key, max_chunk_size_);
+    // msg lives in the control queue only until this handler returns, the open completes later
+    auto pid = msg.pid;
+    auto open = std::make_shared<WsOpen>(*req);
     asio::spawn(
-        ioc_,
-        std::bind(&Websocket::open, websocket, [this, websocket, &msg, req](bool success) {
-            if (success) {
-                onWsOpened(websocket->id(), msg.pid);
-                req->id = websocket->id();
-                req->client_pid = msg.pid;
-                websocket->clients().emplace(msg.pid);
-                websocketsByUrlApiKey_.emplace(WebsocketKey(req->url, req->api_key), websocket);
-                websocketsById_.emplace(websocket->id(), std::move(websocket));
-                msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
-            } else {
-                msg.status.store(Message::Status::FAILED, std::memory_order_release);
-            }
+        websocket->executor(),
+        std::bind(&Websocket::open, websocket, [this, websocket, ref, pid, open](bool success) {
+            // the websocket runs on its io worker, book keeping is done on the control thread
+            ioc_.post([this, websocket, ref, pid, open, success]() {
+                auto req = open.get();
+                if (success) {
+                    onWsOpened(websocket->id(), pid);
+                    req->id = websocket->id();
+                    req->client_pid = pid;
+                    websocket->clients().emplace(pid);
+                    websocketsByUrlApiKey_.emplace(WebsocketKey(req->url, req->api_key), websocket);
+                    websocketsById_.emplace(websocket->id(), websocket);
+                }
+                replyToClient(ref, success ? Message::Status::SUCCESS : Message::Status::FAILED, [req](Message& request) {
+                    memcpy(request.data, req, sizeof(WsOpen));
+                });
+                server_notifier_->notify();
+            });
         }, std::placeholders::_1),
         // on completion, spawn will call this function
-        [&msg](std::exception_ptr ex) {
+        [this, ref](std::exception_ptr ex) {
             // if an exception occurred in the coroutine,
             // it's something critical, e.g. out of memory
             // we capture normal errors in the ec
@@ -430,7 +1072,7 @@ void WebsocketProxy::openNewWs(Message& msg, WsOpen* req) {
             // which will cause `ioc.run()` to throw
             if (ex) {
                 LOG_INFO("Open Failed......");
-                msg.status.store(Message::Status::FAILED, std::memory_order_release);
+                ioc_.post([this, ref]() { replyToClient(ref, Message::Status::FAILED, [](Message&) {}); });
                 std::rethrow_exception(ex);
             }
         });
@@ -466,7 +1108,43 @@ void WebsocketProxy::closeWs(uint64_t id, uint64_t pid) {
         LOG_DEBUG("Close ws. socket not found id={}", id);
     }
 }
-void WebsocketProxy::handleSubscribe(Message& msg) {
+
+void WebsocketProxy::flushSubscribes() {
+    if (subscribe_merger_.empty()) {
+        return;
+    }
+    auto it = websocketsById_.find(subscribe_merger_ws_);
+    if (it != websocketsById_.end()) {
+        auto request = subscribe_merger_.build();
+        if (subscribe_merger_.count() > 1) {
+            LOG_DEBUG("Merged {} subscribe requests for ws_id={}", subscribe_merger_.count(), subscribe_merger_ws_);
+        }
+        it->second->send(request.c_str(), request.size());
+    }
+    subscribe_merger_.clear();
+}
+
+void WebsocketProxy::sendSubscribeRequest(Websocket& websocket, const WsSubscription* req, bool merge) {
+    if (websocket.reconnecting_) {
+        // sent with the replay
+        return;
+    }
+    if (merge && subscribe_merger_ws_ == websocket.id()) {
+        if (subscribe_merger_.add(req->request, req->request_len)) {
+            return;
+        }
+        // e.g. a different action, start a new merge
+        flushSubscribes();
+        if (subscribe_merger_.add(req->request, req->request_len)) {
+            return;
+        }
+    }
+    // not mergeable, keep the upstream order of requests
+    flushSubscribes();
+    websocket.send(req->request, req->request_len);
+}
+
+void WebsocketProxy::handleSubscribe(Message& msg, bool merge) {
     auto req = reinterpret_cast<WsSubscription*>(msg.data);
     auto client = getClient(msg.pid);
     if (client) {
@@ -474,21 +1152,52 @@ void WebsocketProxy::handleSubscribe(Message& msg) {
         LOG_INFO("Subscribe {} client={} ws_id={} type={}", symbol_view, msg.pid, req->id, (int)req->type);
         auto it = websocketsById_.find(req->id);
         if (it != websocketsById_.end()) {
-            auto& subscriptions = it->second->subscriptions_;
-            auto sub_it = subscriptions.find(std::string(symbol_view));
-            if (sub_it == subscriptions.end()) {
-                auto [sub_it, b] = subscriptions.emplace(symbol_view, req->type);
-                sub_it->second.clients_.emplace(msg.pid);
-                it->second->send(req->request, req->request_len);
+            auto symbol_id = symbols_.intern(symbol_view);
+            auto sub = symbol_id != SymbolTable::kInvalidId ? it->second->subscriptions_.insert(symbol_id) : nullptr;
+            if (!sub) {
+                LOG_ERROR("Subscription table full. symbol={} ws_id={} symbols={}", symbol_view, req->id, symbols_.size());
+            }
+            else if (sub->type.load(std::memory_order_relaxed) == SubscriptionType::None) {
+                if (options_.last_value_cache) {
+                    // values cached before the symbol was unsubscribed upstream, possibly long ago. Cleared on the
+                    // strand, which caches them, before the subscribe request is written.
+                    asio::dispatch(it->second->executor(), [sub]() {
+                        if (auto last = sub->last_value.load(std::memory_order_relaxed)) {
+                            last->clear();
+                        }
+                    });
+                }
+                sub->type.store(req->type, std::memory_order_relaxed);
+                sub->addClient(client->slot);
+                if (req->type & SubscriptionType::Quotes) {
+                    // only quotes are conflated, a trades subscription keeps the quotes interval
+                    setConflation(*it->second, *sub, *client, symbol_id, req->conflate_ms);
+                }
+                sendSubscribeRequest(*it->second, req, merge);
+                it->second->subscribe_requests_[symbol_id].emplace_back(req->request, req->request_len);
                 msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
                 return;
             }
             else {
-                sub_it->second.clients_.emplace(msg.pid);
-                if (!(sub_it->second.type_ & req->type))
+                if (options_.last_value_cache && !sub->isSnapshotPending(client->slot)) {
+                    // Sent on the websocket's strand, where values are cached and routed. The client isn't
+                    // routed to until then, so no value is missed or followed by an older cached one.
+                    sub->setSnapshotPending(client->slot);
+                    asio::dispatch(it->second->executor(), [this, websocket = it->second, sub, slot = client->slot, types = sub->type.load(std::memory_order_relaxed) & req->type]() {
+                        sendLastValues(*websocket, *sub, types, slot);
+                    });
+                }
+                sub->addClient(client->slot);
+                if (req->type & SubscriptionType::Quotes) {
+                    // only quotes are conflated, a trades subscription keeps the quotes interval
+                    setConflation(*it->second, *sub, *client, symbol_id, req->conflate_ms);
+                }
+                auto type = sub->type.load(std::memory_order_relaxed);
+                if (!(type & req->type))
                 {
-                    it->second->send(req->request, req->request_len);
-                    sub_it->second.type_ |= req->type;
+                    sendSubscribeRequest(*it->second, req, merge);
+                    it->second->subscribe_requests_[symbol_id].emplace_back(req->request, req->request_len);
+                    sub->type.store(static_cast<uint8_t>(type | req->type), std::memory_order_relaxed);
                 }
                 req->existing = true;
                 msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
@@ -513,14 +1222,17 @@ void WebsocketProxy::handleUnsubscribe(Message& msg) {
         LOG_INFO("Unsubscribe {} client={} ws_id={}", symbol_view, msg.pid, req->id);
         auto it = websocketsById_.find(req->id);
         if (it != websocketsById_.end()) {
-            auto& subscriptions = it->second->subscriptions_;
-            auto sub_it = subscriptions.find(std::string(symbol_view));
-            if (sub_it != subscriptions.end()) {
-                sub_it->second.clients_.erase(msg.pid);
-                if (sub_it->second.clients_.empty()) {
-                    
-                    subscriptions.erase(sub_it);
-                    it->second->send(req->request, req->request_len);
+            auto symbol_id = symbols_.find(symbol_view);
+            auto sub = symbol_id != SymbolTable::kInvalidId ? it->second->subscriptions_.find(symbol_id) : nullptr;
+            if (sub && sub->type.load(std::memory_order_relaxed) != SubscriptionType::None) {
+                sub->removeClient(client->slot);
+                setConflation(*it->second, *sub, *client, symbol_id, 0);
+                if (!sub->hasClients()) {
+                    sub->type.store(SubscriptionType::None, std::memory_order_relaxed);
+                    it->second->subscribe_requests_.erase(symbol_id);
+                    if (!it->second->reconnecting_) {
+                        it->second->send(req->request, req->request_len);
+                    }
                 }
             }
             else {
@@ -543,7 +1255,7 @@ void WebsocketProxy::sendWsRequest(Message& msg) {
     if (client) {
         auto it = websocketsById_.find(req->id);
         if (it != websocketsById_.end()) {
-            it->second->send(req->data, req->len);
+            it->second->send(req->data, req->len, msg.pid);
             msg.status.store(Message::Status::SUCCESS, std::memory_order_release);
             return;
         }
@@ -564,8 +1276,14 @@ void WebsocketProxy::sendMessageToClient(uint64_t index, uint32_t size) {
 }
 
 void WebsocketProxy::sendMessageToClient(uint64_t index, uint32_t size, uint64_t now) {
-    server_queue_.publish(index, size);
-    last_heartbeat_time_ = now;
+    publishMessage(server_queue_, reinterpret_cast<Message*>(server_queue_[index]), index, size);
+    server_notifier_->notify();
+    last_heartbeat_time_.store(now, std::memory_order_relaxed);
+}
+
+void WebsocketProxy::publishToClient(SHM_QUEUE_T& queue, Message* msg, uint64_t index, uint32_t size) {
+    publishMessage(queue, msg, index, size);
+    server_notifier_->notify();
 }
 
 bool WebsocketProxy::checkHeartbeats() {
@@ -594,9 +1312,8 @@ bool WebsocketProxy::sendHeartbeat() {
 }
 
 bool WebsocketProxy::sendHeartbeat(uint64_t now) {
-    if ((now - last_heartbeat_time_) > HEARTBEAT_INTERVAL) {
-        auto [msg, index, size] = reserveMessage();
-        msg->type = Message::Type::Heartbeat;
+    if ((now - last_heartbeat_time_.load(std::memory_order_relaxed)) > HEARTBEAT_INTERVAL) {
+        auto [msg, body, index, size] = reserveMessage(Message::Type::Heartbeat);
         sendMessageToClient(index, size, now);
         return true;
     }
@@ -618,9 +1335,17 @@ void WebsocketProxy::removeClosedSockets() {
 
 // Websocket Callbacks
 void WebsocketProxy::onWsOpened(uint64_t id, uint64_t client_pid) {
-    auto [msg, index, size] = reserveMessage<WsOpen>();
-    msg->type = Message::Type::OpenWs;
-    auto open = reinterpret_cast<WsOpen*>(msg->data);
+    // A routed client gets its data on its own queue, the ack goes there too so it is read before any data
+    auto it = client_data_queues_.find(client_pid);
+    if (it != client_data_queues_.end()) {
+        auto [msg, open, index, size] = reserveMessage<WsOpen>(*it->second, Message::Type::OpenWs);
+        open->id = id;
+        open->client_pid = client_pid;
+        open->new_connection = true;
+        publishToClient(*it->second, msg, index, size);
+        return;
+    }
+    auto [msg, open, index, size] = reserveMessage<WsOpen>(Message::Type::OpenWs);
     open->id = id;
     open->client_pid = client_pid;
     open->new_connection = true;
@@ -628,23 +1353,20 @@ void WebsocketProxy::onWsOpened(uint64_t id, uint64_t client_pid) {
 }
 
 void WebsocketProxy::onWsClosed(uint64_t id) {
-    auto [msg, index, size] = reserveMessage<WsClose>();
-    msg->type = Message::Type::CloseWs;
-    auto wsclose = reinterpret_cast<WsClose*>(msg->data);
+    auto [msg, wsclose, index, size] = reserveMessage<WsClose>(Message::Type::CloseWs);
     wsclose->id = id;
     sendMessageToClient(index, size);
 
     auto idx = closed_sockets_.reserve();
     (*closed_sockets_[idx]) = id;
     closed_sockets_.publish(idx);
+    ioc_.post([this]() { removeClosedSockets(); });
 
     LOG_INFO("Ws {} closed", id);
 }
 
 void WebsocketProxy::onWsError(uint64_t id, const char* err, uint32_t len) {
-    auto [msg, index, size] = reserveMessage<WsError>(len);
-    msg->type = Message::Type::WsError;
-    auto e = reinterpret_cast<WsError*>(msg->data);
+    auto [msg, e, index, size] = reserveMessage<WsError>(Message::Type::WsError, len);
     e->id = id;
     e->len = len;
     if (err && len) {
@@ -653,15 +1375,461 @@ void WebsocketProxy::onWsError(uint64_t id, const char* err, uint32_t len) {
     sendMessageToClient(index, size);
 }
 
-void WebsocketProxy::onWsData(uint64_t id, const char* data, uint32_t len, uint32_t remaining) {
-    auto [msg, index, size] = reserveMessage<WsData>(len);
-    msg->type = Message::Type::WsData;
-    auto d = reinterpret_cast<WsData*>(msg->data);
+void WebsocketProxy::onWsReconnecting(uint64_t id) {
+    // called from the websocket's io worker thread
+    ioc_.post([this, id]() {
+        auto it = websocketsById_.find(id);
+        if (it != websocketsById_.end()) {
+            it->second->reconnecting_ = true;
+        }
+    });
+    auto [msg, reconnect, index, size] = reserveMessage<WsReconnect>(Message::Type::ReconnectWs);
+    reconnect->id = id;
+    reconnect->connected = false;
+    sendMessageToClient(index, size);
+}
+
+void WebsocketProxy::onWsReconnected(uint64_t id) {
+    // called from the websocket's io worker thread, the subscriptions are replayed on the control thread
+    ioc_.post([this, id]() {
+        auto it = websocketsById_.find(id);
+        if (it == websocketsById_.end()) {
+            return;
+        }
+        auto& websocket = *it->second;
+        if (websocket.has_auth_request_) {
+            // the websocket sent the authentication request first, subscriptions are replayed once it succeeded
+            websocket.auth_state_ = Websocket::AuthState::Pending;
+            websocket.auth_start_time_ = get_timestamp();
+            websocket.replay_after_auth_ = true;
+            return;
+        }
+        if (websocket.replay_after_auth_) {
+            // the authentication failed before, replayed once a client authenticates
+            reportReplayBlocked(websocket, "not authenticated");
+            return;
+        }
+        completeReconnect(websocket);
+    });
+}
+
+void WebsocketProxy::completeReconnect(Websocket& websocket) {
+    websocket.reconnecting_ = false;
+    replaySubscriptions(websocket);
+    LOG_INFO("Websocket {} reconnected, id={}, {} symbols resubscribed", websocket.url_, websocket.id(), websocket.subscribe_requests_.size());
+    auto [msg, reconnect, index, size] = reserveMessage<WsReconnect>(Message::Type::ReconnectWs);
+    reconnect->id = websocket.id();
+    reconnect->connected = true;
+    sendMessageToClient(index, size);
+}
+
+void WebsocketProxy::onWsAuthenticated(uint64_t id, bool success, std::string_view response) {
+    // called from the websocket's io worker thread
+    ioc_.post([this, id, success, response = std::string(response)]() {
+        auto it = websocketsById_.find(id);
+        if (it != websocketsById_.end()) {
+            if (!success) {
+                // rejected upstream, the websocket dropped the request
+                it->second->has_auth_request_ = false;
+            }
+            completeAuth(*it->second, success, response);
+        }
+    });
+}
+
+void WebsocketProxy::replaySubscriptions(Websocket& websocket) {
+    // merged into as few requests as possible, like consecutive client subscriptions
+    flushSubscribes();
+    subscribe_merger_ws_ = websocket.id();
+    for (auto& [symbol_id, requests] : websocket.subscribe_requests_) {
+        for (auto& request : requests) {
+            auto len = static_cast<uint32_t>(request.size());
+            if (!subscribe_merger_.add(request.c_str(), len)) {
+                flushSubscribes();
+                if (!subscribe_merger_.add(request.c_str(), len)) {
+                    websocket.send(request.c_str(), len);
+                }
+            }
+        }
+    }
+    flushSubscribes();
+}
+
+void WebsocketProxy::onWsData(uint64_t id, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time) {
+    auto [msg, d, index, size] = reserveMessage<WsData>(Message::Type::WsData, len);
     d->id = id;
     d->len = len;
     d->remaining = remaining;
+    d->recv_time = recv_time;
     if (data && len) {
         memcpy(d->data, data, len);
     }
     sendMessageToClient(index, size);
-}
\ No newline at end of file
+}
+
+void WebsocketProxy::onWsData(Websocket& websocket, const char* data, uint32_t len, uint32_t remaining, bool fragment, uint64_t recv_time) {
+    // called from the websocket's io worker thread
+    if (fragment) {
+        // A chunk can't be split or routed on its own. Every chunk of a large message,
+        // e.g. a snapshot, goes to every client in order through the server queue.
+        onWsData(websocket.id(), data, len, remaining, recv_time);
+        return;
+    }
+
+    thread_local std::vector<FramePart> frame_parts;
+    if (splitter_ && splitter_->split(data, len, frame_parts)) {
+        for (auto& part : frame_parts) {
+            if (options_.route_by_symbol && !part.symbol.empty()) {
+                routeFramePart(websocket, part, recv_time);
+                continue;
+            }
+            MarketData record;
+            Message::Type type;
+            if (options_.binary_market_data && market_data::decode(part.data, part.len, websocket.id(), recv_time, type, record)) {
+                publishMarketData(server_queue_, type, record);
+            }
+            else {
+                publishFramePart(server_queue_, websocket.id(), part, recv_time);
+            }
+        }
+        return;
+    }
+
+    if (options_.route_by_symbol) {
+        routeWsData(websocket, data, len, 0, recv_time);
+    }
+    else {
+        onWsData(websocket.id(), data, len, 0, recv_time);
+    }
+}
+
+void WebsocketProxy::routeWsData(Websocket& websocket, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time) {
+    ClientSet targets;
+    auto& subscriptions = websocket.subscriptions_;
+    uint32_t symbols = 0;
+    SubscriptionTable::Entry* last_sub = nullptr;
+    auto has_symbol = json::forEachSymbol(data, len, [this, &subscriptions, &targets, &symbols, &last_sub](std::string_view symbol) {
+        ++symbols;
+        auto symbol_id = symbols_.find(symbol);
+        if (symbol_id != SymbolTable::kInvalidId) {
+            if (auto sub = subscriptions.find(symbol_id)) {
+                sub->collectClients(targets);
+                last_sub = sub;
+            }
+        }
+    });
+
+    if (!has_symbol) {
+        // control messages, e.g. auth or subscription responses, go to every client
+        onWsData(websocket.id(), data, len, remaining, recv_time);
+        return;
+    }
+
+    if (symbols == 1 && last_sub) {
+        // frames of several symbols are only cached or conflated once split, see ProxyOptions::split_frames
+        if (options_.last_value_cache) {
+            cacheLastValue(*last_sub, data, len, false, recv_time);
+        }
+        if (last_sub->hasConflated()) {
+            auto type = messageType(data, len);
+            if (type == SubscriptionType::Quotes) {
+                conflateQuote(*last_sub, targets, data, len, false, recv_time);
+            }
+            else if (type == SubscriptionType::Trades) {
+                flushConflatedQuotes(websocket, *last_sub, targets);
+            }
+        }
+    }
+
+    targets.forEach([&](uint32_t slot) {
+        if (auto queue = client_slot_queues_[slot].load(std::memory_order_acquire)) {
+            publishWsData(*queue, websocket.id(), data, len, remaining, recv_time);
+        }
+    });
+}
+
+void WebsocketProxy::routeFramePart(Websocket& websocket, const FramePart& part, uint64_t recv_time) {
+    auto symbol_id = symbols_.find(part.symbol);
+    if (symbol_id == SymbolTable::kInvalidId) {
+        return;
+    }
+    auto sub = websocket.subscriptions_.find(symbol_id);
+    if (!sub) {
+        return;
+    }
+    if (options_.last_value_cache) {
+        cacheLastValue(*sub, part.data, part.len, true, recv_time);
+    }
+    ClientSet targets;
+    sub->collectClients(targets);
+    if (sub->hasConflated()) {
+        auto type = messageType(part.data, part.len);
+        if (type == SubscriptionType::Quotes) {
+            conflateQuote(*sub, targets, part.data, part.len, true, recv_time);
+        }
+        else if (type == SubscriptionType::Trades) {
+            flushConflatedQuotes(websocket, *sub, targets);
+        }
+    }
+    // decoded once for every target
+    MarketData record;
+    Message::Type type;
+    auto binary = options_.binary_market_data && market_data::decode(part.data, part.len, websocket.id(), recv_time, type, record);
+    targets.forEach([&](uint32_t slot) {
+        if (auto queue = client_slot_queues_[slot].load(std::memory_order_acquire)) {
+            if (binary) {
+                publishMarketData(*queue, type, record);
+            }
+            else {
+                publishFramePart(*queue, websocket.id(), part, recv_time);
+            }
+        }
+    });
+}
+
+void WebsocketProxy::publishWsData(SHM_QUEUE_T& queue, uint64_t id, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time) {
+    auto [msg, d, index, size] = reserveMessage<WsData>(queue, Message::Type::WsData, len);
+    d->id = id;
+    d->len = len;
+    d->remaining = remaining;
+    d->recv_time = recv_time;
+    if (data && len) {
+        memcpy(d->data, data, len);
+    }
+    publishToClient(queue, msg, index, size);
+}
+
+void WebsocketProxy::setConflation(Websocket& websocket, SubscriptionTable::Entry& sub, ClientInfo& client, uint32_t symbol_id, uint32_t interval_ms) {
+    auto it = std::find_if(client.conflated.begin(), client.conflated.end(), [&websocket, symbol_id](const ClientInfo::Conflated& c) {
+        return c.websocket_id == websocket.id() && c.symbol_id == symbol_id;
+    });
+    auto bit = 1ULL << (client.slot & 63);
+    if (!interval_ms || !options_.route_by_symbol) {
+        // every quote again
+        sub.conflated[client.slot >> 6].fetch_and(~bit, std::memory_order_relaxed);
+        if (it != client.conflated.end()) {
+            client.conflated.erase(it);
+        }
+        return;
+    }
+
+    if (!sub.conflated_values) {
+        sub.conflated_values = std::make_unique<std::atomic<ConflatedValue*>[]>(kMaxClients);
+    }
+    auto value = sub.conflated_values[client.slot].load(std::memory_order_relaxed);
+    if (!value) {
+        value = new ConflatedValue();
+        sub.conflated_values[client.slot].store(value, std::memory_order_release);
+    }
+    value->pending.store(false, std::memory_order_relaxed);
+    sub.conflated[client.slot >> 6].fetch_or(bit, std::memory_order_release);
+
+    interval_ms = std::max(interval_ms, kConflationTick);
+    if (it != client.conflated.end()) {
+        it->interval_ms = interval_ms;
+    }
+    else {
+        client.conflated.push_back({ websocket.id(), symbol_id, value, interval_ms, get_timestamp() + interval_ms });
+    }
+    startConflationTimer();
+}
+
+void WebsocketProxy::conflateQuote(SubscriptionTable::Entry& sub, ClientSet& targets, const char* data, uint32_t len, bool wrap, uint64_t recv_time) {
+    // called from the websocket's io worker thread. The quote replaces the pending one of every
+    // conflated client instead of being published to it.
+    for (uint32_t i = 0; i < ClientSet::kWords; ++i) {
+        for (auto word = targets.words[i] & sub.conflated[i].load(std::memory_order_acquire); word; word &= word - 1) {
+            auto slot = (i << 6) + std::countr_zero(word);
+            auto value = sub.conflated_values[slot].load(std::memory_order_acquire);
+            if (value && value->value.store(data, len, wrap, recv_time)) {
+                value->pending.store(true, std::memory_order_release);
+                targets.reset(slot);
+            }
+        }
+    }
+}
+
+void WebsocketProxy::flushConflatedQuotes(Websocket& websocket, SubscriptionTable::Entry& sub, const ClientSet& targets) {
+    // called from the websocket's io worker thread before a trade is routed, a quote received
+    // before the trade is delivered before it
+    for (uint32_t i = 0; i < ClientSet::kWords; ++i) {
+        for (auto word = targets.words[i] & sub.conflated[i].load(std::memory_order_acquire); word; word &= word - 1) {
+            auto slot = (i << 6) + std::countr_zero(word);
+            auto value = sub.conflated_values[slot].load(std::memory_order_acquire);
+            auto queue = client_slot_queues_[slot].load(std::memory_order_acquire);
+            if (value && queue) {
+                publishConflated(*queue, websocket.id(), *value);
+            }
+        }
+    }
+}
+
+void WebsocketProxy::publishConflated(SHM_QUEUE_T& queue, uint64_t websocket_id, ConflatedValue& value) {
+    // on the websocket's strand, so a flushed quote can't overtake a trade routed after it
+    if (value.pending.exchange(false, std::memory_order_acq_rel)) {
+        char data[ValueSlot::kMaxLen];
+        uint64_t recv_time;
+        if (auto len = value.value.load(data, recv_time)) {
+            publishValue(queue, websocket_id, data, len, recv_time);
+        }
+    }
+}
+
+void WebsocketProxy::startConflationTimer() {
+    if (conflation_timer_running_) {
+        return;
+    }
+    conflation_timer_running_ = true;
+    conflation_timer_.expires_after(std::chrono::milliseconds(kConflationTick));
+    conflation_timer_.async_wait([this](const boost::system::error_code& ec) {
+        conflation_timer_running_ = false;
+        if (!ec) {
+            flushConflated();
+        }
+    });
+}
+
+void WebsocketProxy::flushConflated() {
+    auto now = get_timestamp();
+    bool active = false;
+    for (auto& [pid, client] : clients_) {
+        // the values belong to the websocket, forget them once it is gone
+        std::erase_if(client.conflated, [this](const ClientInfo::Conflated& c) { return !websocketsById_.contains(c.websocket_id); });
+        if (client.conflated.empty()) {
+            continue;
+        }
+        active = true;
+        auto queue = client_data_queues_.find(pid);
+        // a client far behind gets nothing new until it catches up, the pending values stay the latest
+        if (queue == client_data_queues_.end() || client.data_queue_lag > options_.client_queue_size / 2) {
+            continue;
+        }
+        for (auto& c : client.conflated) {
+            if (now < c.next_flush) {
+                continue;
+            }
+            c.next_flush = now + c.interval_ms;
+            if (c.value->pending.load(std::memory_order_relaxed)) {
+                // published on the websocket's strand, ordered with the trades routed there
+                auto websocket = websocketsById_.at(c.websocket_id);
+                asio::dispatch(websocket->executor(), [this, websocket, value = c.value, slot = client.slot]() {
+                    if (auto queue = client_slot_queues_[slot].load(std::memory_order_acquire)) {
+                        publishConflated(*queue, websocket->id(), *value);
+                    }
+                });
+            }
+        }
+    }
+    if (active && run_.load(std::memory_order_relaxed)) {
+        startConflationTimer();
+    }
+}
+
+void WebsocketProxy::cacheLastValue(SubscriptionTable::Entry& sub, const char* data, uint32_t len, bool wrap, uint64_t recv_time) {
+    // called from the websocket's io worker thread, the only writer of its subscriptions' values
+    auto type = messageType(data, len);
+    if (type == SubscriptionType::None) {
+        return;
+    }
+    auto kind = type == SubscriptionType::Quotes ? LastValue::kQuote : LastValue::kTrade;
+    auto last = sub.last_value.load(std::memory_order_relaxed);
+    if (!last) [[unlikely]] {
+        last = new LastValue();
+        sub.last_value.store(last, std::memory_order_release);
+    }
+    last->slots[kind].store(data, len, wrap, recv_time);
+}
+
+void WebsocketProxy::sendLastValues(const Websocket& websocket, SubscriptionTable::Entry& sub, uint8_t types, uint32_t slot) {
+    // on the websocket's strand
+    if (!sub.isSnapshotPending(slot)) {
+        // unsubscribed meanwhile
+        return;
+    }
+    auto last = sub.last_value.load(std::memory_order_acquire);
+    auto queue = client_slot_queues_[slot].load(std::memory_order_acquire);
+    if (last && queue) {
+        char value[ValueSlot::kMaxLen];
+        for (auto kind : { LastValue::kQuote, LastValue::kTrade }) {
+            if (types & (1 << kind)) {
+                uint64_t recv_time;
+                if (auto len = last->slots[kind].load(value, recv_time)) {
+                    publishValue(*queue, websocket.id(), value, len, recv_time);
+                }
+            }
+        }
+    }
+    sub.clearSnapshotPending(slot);
+}
+
+std::tuple<WsData*, uint64_t, uint32_t> WebsocketProxy::reserveWsData(uint64_t id, uint32_t len) {
+    // the payload is written by the reader
+    auto [msg, d, index, size] = reserveMessage<WsData>(Message::Type::WsData, len);
+    d->id = id;
+    d->len = len;
+    return std::make_tuple(d, index, size);
+}
+
+void WebsocketProxy::publishWsData(uint64_t index, uint32_t size) {
+    sendMessageToClient(index, size);
+}
+
+void WebsocketProxy::publishFramePart(SHM_QUEUE_T& queue, uint64_t id, const FramePart& part, uint64_t recv_time) {
+    // keep the array framing of the original frame so clients parse a part like a whole frame
+    auto len = part.len + 2;
+    auto [msg, d, index, size] = reserveMessage<WsData>(queue, Message::Type::WsData, len);
+    d->id = id;
+    d->len = len;
+    d->remaining = 0;
+    d->recv_time = recv_time;
+    d->data[0] = '[';
+    memcpy(d->data + 1, part.data, part.len);
+    d->data[len - 1] = ']';
+    if (&queue == &server_queue_) {
+        sendMessageToClient(index, size);
+    }
+    else {
+        publishToClient(queue, msg, index, size);
+    }
+}
+
+void WebsocketProxy::publishValue(SHM_QUEUE_T& queue, uint64_t websocket_id, const char* data, uint32_t len, uint64_t recv_time) {
+    // A cached or conflated value, kept as JSON. With binary_market_data it is delivered like the live stream.
+    if (options_.binary_market_data) {
+        MarketData record;
+        Message::Type type;
+        bool decoded = false;
+        json::forEachObject(data, len, [&](const char* obj, size_t n) {
+            decoded = market_data::decode(obj, n, websocket_id, recv_time, type, record);
+        });
+        if (decoded) {
+            publishMarketData(queue, type, record);
+            return;
+        }
+    }
+    publishWsData(queue, websocket_id, data, len, 0, recv_time);
+}
+
+void WebsocketProxy::publishMarketData(SHM_QUEUE_T& queue, Message::Type type, const MarketData& record) {
+    auto publish = [this, &queue, type](const auto& value) {
+        auto [msg, d, index, size] = reserveMessage<std::decay_t<decltype(value)>>(queue, type);
+        *d = value;
+        if (&queue == &server_queue_) {
+            sendMessageToClient(index, size);
+        }
+        else {
+            publishToClient(queue, msg, index, size);
+        }
+    };
+    switch (type) {
+    case Message::Type::Quote:
+        publish(record.quote);
+        break;
+    case Message::Type::Trade:
+        publish(record.trade);
+        break;
+    default:
+        publish(record.bar);
+        break;
+    }
+}
@@ -21,11 +21,24 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <websocket_proxy/platform.h>
 #include <websocket_proxy/types.h>
+#include <websocket_proxy/notifier.h>
+#include <websocket_proxy/latency_histogram.h>
+#include <websocket_proxy/stats.h>
 #include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include "frame_splitter.h"
+#include "request_merger.h"
+#include "shm_placement.h"
+#include "symbol_table.h"
 
 namespace asio = boost::asio;    // from <boost/asio.hpp>
 namespace ssl = asio::ssl;       // from <boost/asio/ssl.hpp>
@@ -34,16 +47,66 @@ namespace websocket_proxy {
 
 class Websocket;
 
+// A client request copied off the client queue. The reply goes to the request in the queue,
+// where the client waits for it, see WebsocketProxy::replyToClient.
+struct RequestRef {
+    uint64_t index;         // of the request in the client queue
+    uint64_t pid;
+    uint64_t timestamp;     // Message::timestamp, tells the request from a later one at the same index
+};
+
+struct ProxyOptions {
+    uint32_t server_queue_size = 1 << 24;   // 16MB
+    // publish symbol data only to the clients subscribed to the symbol,
+    // through a dedicated queue per client
+    bool route_by_symbol = false;
+    uint32_t client_queue_size = 1 << 22;   // 4MB
+    // split batched JSON array frames into one message per object, requires route_by_symbol
+    bool split_frames = false;
+    // microseconds to spin on an empty client queue before blocking on the notifier, < 0 never blocks
+    int64_t client_spin_us = 50;
+    // max client requests handled per io_context handler
+    uint32_t client_batch_size = 64;
+    // io_context threads the upstream websockets are sharded across,
+    // 0 runs them on the control thread with the client requests
+    uint32_t io_threads = 0;
+    // upstream messages larger than this are streamed to the clients in chunks, see WsData::remaining
+    uint32_t max_chunk_size = 1 << 18;      // 256KB
+    // read the payload of large frames straight into the server queue, see Websocket::startDirectRead
+    bool zero_copy_reads = false;
+    // dropped upstream websockets are reconnected with exponential backoff up to this,
+    // 0 closes them and the clients have to open them again
+    uint32_t max_reconnect_backoff_ms = 5000;
+    // cache the last quote and trade per symbol, sent to clients subscribing to an already subscribed symbol.
+    // Requires route_by_symbol.
+    bool last_value_cache = false;
+    // decode Alpaca quotes, trades and bars once into QuoteMessage, TradeMessage and BarMessage records
+    // instead of forwarding their JSON, see market_data.h. Batched frames are split as with split_frames.
+    bool binary_market_data = false;
+    // clients further behind a queue head than this are unregistered, bytes. 0 never disconnects
+    uint64_t max_client_lag = 0;
+    // huge pages, prefault and NUMA node of the server, client and data queues
+    ShmPlacement shm_placement;
+};
+
 class WebsocketProxy final {
+    // client to server requests, see readClientMessages
+    static constexpr uint32_t kClientQueueSize = 1 << 16;
+
+    const ProxyOptions options_;
     std::atomic_bool run_{ true };
     SHM_QUEUE_T client_queue_;
     SHM_QUEUE_T server_queue_;
+    // created in run() once this proxy owns the session, creating one resets its state
+    std::unique_ptr<Notifier> client_notifier_;
+    // wakes clients blocked on their queues, see WebsocketProxyClient::WaitPolicy::Block. Created with client_notifier_.
+    std::unique_ptr<Notifier> server_notifier_;
     uint64_t client_index_ = 0;
-    uint64_t last_heartbeat_time_ = 0;
+    std::atomic<uint64_t> last_heartbeat_time_{ 0 };
     uint64_t shutdown_time_ = 0;
     const uint64_t pid_;
-    HANDLE hMapFile_ = nullptr;
-    LPVOID lpvMem_ = nullptr;
+    // holds the pid of the running proxy, only one proxy per session
+    std::unique_ptr<SharedMemory> owner_shm_;
     bool own_shm_ = false;
     std::atomic<uint64_t>* owner_pid_ = nullptr;
     std::string exec_path_;
@@ -51,8 +114,39 @@ class WebsocketProxy final {
     struct ClientInfo {
         uint64_t pid;
         uint64_t last_heartbeat_time;
+        uint32_t slot;
+        // last latencies the client reported, see StatsMessage
+        LatencyStats queue_residency{};
+        LatencyStats callback{};
+        std::string name;
+        // from the client's last heartbeat
+        uint64_t server_queue_cursor = 0;
+        uint64_t data_queue_cursor = 0;
+        uint64_t messages_consumed = 0;
+        uint64_t cursor_time = 0;
+        // bytes behind the queue heads, see checkClientLag
+        uint64_t server_queue_lag = 0;
+        uint64_t data_queue_lag = 0;
+        uint64_t overruns = 0;
+        bool overrun_notified = false;
+        // quotes delivered conflated, see flushConflated
+        struct Conflated {
+            uint64_t websocket_id;
+            uint32_t symbol_id;
+            ConflatedValue* value;
+            uint32_t interval_ms;
+            uint64_t next_flush;
+        };
+        std::vector<Conflated> conflated;
     };
     std::unordered_map<uint64_t, ClientInfo> clients_;
+    ClientSet used_client_slots_;
+
+    // Routing state read by the io threads without locking, only modified on the control thread.
+    // Symbols are interned once, Websocket::subscriptions_ map symbol ids to client slots.
+    SymbolTable symbols_;
+    std::array<std::atomic<SHM_QUEUE_T*>, kMaxClients> client_slot_queues_{};
+    std::unordered_map<uint64_t, std::unique_ptr<SHM_QUEUE_T>> client_data_queues_;
     std::unordered_map<uint64_t, std::shared_ptr<Websocket>> websocketsById_;
 
     struct WebsocketKey
@@ -80,13 +174,61 @@ class WebsocketProxy final {
     std::unordered_map<WebsocketKey, std::shared_ptr<Websocket>, WebsocketKeyHash, WebsocketKeyEqual> websocketsByUrlApiKey_;
     slick::SlickQueue<uint64_t> closed_sockets_;
     uint64_t closed_sockets_index_ = 0;
+    std::unique_ptr<FrameSplitter> splitter_;
+    // options_.max_chunk_size capped so a chunk always fits in the queues
+    uint32_t max_chunk_size_ = 0;
 
+    // control thread: client requests, heartbeats and websocket bookkeeping
     asio::io_context ioc_;
     ssl::context ctx_{ssl::context::tlsv12_client};
+    asio::steady_timer housekeeping_timer_{ioc_};
+    // delivers conflated quotes while any client receives them, every kConflationTick ms
+    static constexpr uint32_t kConflationTick = 10;
+    asio::steady_timer conflation_timer_{ioc_};
+    bool conflation_timer_running_ = false;
+
+    // upstream websockets are assigned round robin to the io workers
+    struct IoWorker {
+        asio::io_context ioc;
+        asio::executor_work_guard<asio::io_context::executor_type> work{ ioc.get_executor() };
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<IoWorker>> io_workers_;
+    uint32_t next_io_worker_ = 0;
+
+    // Client requests are copied off client_queue_ by the reader thread, the queue is small and may wrap
+    // before they are handled, and handed to the control thread through control_queue_. An entry is the
+    // request's index in client_queue_ followed by the message. A drain handler is only posted when none is pending.
+    static constexpr uint32_t kControlQueueSize = 1 << 20;
+    std::thread client_reader_;
+    slick::SlickQueue<uint8_t> control_queue_;
+    uint64_t control_queue_index_ = 0;
+    // control_queue_index_ published to the reader thread once an entry is handled
+    std::atomic_uint64_t control_queue_cursor_{ 0 };
+    std::atomic_bool drain_scheduled_{ false };
+    // consecutive subscriptions to one websocket are sent upstream as a single request
+    RequestMerger subscribe_merger_;
+    uint64_t subscribe_merger_ws_ = 0;
+
+    // client publish to handling on the io thread, in ns
+    LatencyHistogram request_latency_;
+    std::atomic<uint64_t> spin_wakeups_{ 0 };
+    std::atomic<uint64_t> blocking_wakeups_{ 0 };
+    uint64_t last_stats_time_ = 0;
+
+    // read-only metrics for monitoring, rewritten by the housekeeping timer, see stats.h
+    std::unique_ptr<SharedMemory> stats_shm_;
+    ProxyStats* stats_ = nullptr;
+    uint64_t last_stats_update_time_ = 0;
+    // overrun notices, kMaxClients entries indexed by client slot
+    std::unique_ptr<SharedMemory> client_status_shm_;
+    ClientStatus* client_status_ = nullptr;
+    // client_index_ of the reader thread
+    std::atomic<uint64_t> client_queue_cursor_{ 0 };
 
 
 public:
-    WebsocketProxy(uint32_t server_queue_size);
+    WebsocketProxy(const ProxyOptions& options);
     ~WebsocketProxy();
 
     void run();
@@ -95,19 +237,44 @@ public:
 private:
     friend class Websocket;
 
-    void startHeartbeat();
-    void processClientMessage();
-    void handleClientMessage(Message& msg);
+    void startHousekeeping();
+    void readClientMessages();
+    void logLatencyStats();
+    void openStatsSegment();
+    void updateStatsSegment(uint64_t now);
+    void drainClientMessages();
+    void startIoWorkers();
+    void stopIoWorkers();
+    asio::io_context& nextIoContext();
+    void handleClientMessage(const RequestRef& ref, Message& msg);
+    // the request in client_queue_, nullptr once the queue may have wrapped over it
+    Message* requestAt(const RequestRef& ref);
+    // fill writes the response fields to the request, the client waits for its status
+    template<typename Fill>
+    void replyToClient(const RequestRef& ref, Message::Status status, Fill&& fill);
     void handleClientRegistration(Message& msg);
     void unregisterClient(uint64_t pid);
     void unregisterClient(std::unordered_map<uint64_t, ClientInfo>::iterator &iter);
     void handleClientHeartbeat(Message& msg);
-    void openWs(Message& msg);
-    void openNewWs(Message& msg, WsOpen* req);
+    void updateClientLag(ClientInfo& client);
+    bool checkClientLag(ClientInfo& client);
+    void checkStalledClients(uint64_t now);
+    void sendOverrun(const ClientInfo& client, bool data_queue, bool disconnected);
+    void openClientStatusSegment();
+    void handleStats(Message& msg);
+    void handleAuth(const RequestRef& ref, Message& msg);
+    void answerAuth(const RequestRef& ref, bool success, std::string_view response);
+    void completeAuth(Websocket& websocket, bool success, std::string_view response);
+    void checkAuthTimeouts(uint64_t now);
+    void reportReplayBlocked(Websocket& websocket, std::string_view reason);
+    void openWs(const RequestRef& ref, Message& msg);
+    void openNewWs(const RequestRef& ref, Message& msg, WsOpen* req);
     void closeWs(Message& msg);
     void closeWs(uint64_t id, uint64_t pid);
     void sendWsRequest(Message& msg);
-    void handleSubscribe(Message& msg);
+    void handleSubscribe(Message& msg, bool merge = false);
+    void sendSubscribeRequest(Websocket& websocket, const WsSubscription* req, bool merge);
+    void flushSubscribes();
     void handleUnsubscribe(Message& msg);
     ClientInfo* getClient(uint64_t pid);
     bool checkHeartbeats();
@@ -118,26 +285,50 @@ private:
     void onWsOpened(uint64_t id, uint64_t client_pid);
     void onWsClosed(uint64_t id);
     void onWsError(uint64_t id, const char* err, uint32_t len);
-    void onWsData(uint64_t id, const char* err, uint32_t len, uint32_t remaining);
+    void onWsReconnecting(uint64_t id);
+    void onWsReconnected(uint64_t id);
+    void completeReconnect(Websocket& websocket);
+    void onWsAuthenticated(uint64_t id, bool success, std::string_view response);
+    void replaySubscriptions(Websocket& websocket);
+    // recv_time is the steady clock ns the websocket read the data, see WsData::recv_time
+    void onWsData(uint64_t id, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time);
+    // fragment is true for every chunk of a message delivered in chunks
+    void onWsData(Websocket& websocket, const char* data, uint32_t len, uint32_t remaining, bool fragment, uint64_t recv_time);
+    void routeWsData(Websocket& websocket, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time);
+    void routeFramePart(Websocket& websocket, const FramePart& part, uint64_t recv_time);
+    void publishWsData(SHM_QUEUE_T& queue, uint64_t id, const char* data, uint32_t len, uint32_t remaining, uint64_t recv_time);
+    void setConflation(Websocket& websocket, SubscriptionTable::Entry& sub, ClientInfo& client, uint32_t symbol_id, uint32_t interval_ms);
+    void conflateQuote(SubscriptionTable::Entry& sub, ClientSet& targets, const char* data, uint32_t len, bool wrap, uint64_t recv_time);
+    void startConflationTimer();
+    void flushConflated();
+    void flushConflatedQuotes(Websocket& websocket, SubscriptionTable::Entry& sub, const ClientSet& targets);
+    void publishConflated(SHM_QUEUE_T& queue, uint64_t websocket_id, ConflatedValue& value);
+    void cacheLastValue(SubscriptionTable::Entry& sub, const char* data, uint32_t len, bool wrap, uint64_t recv_time);
+    void sendLastValues(const Websocket& websocket, SubscriptionTable::Entry& sub, uint8_t types, uint32_t slot);
+    void publishFramePart(SHM_QUEUE_T& queue, uint64_t id, const FramePart& part, uint64_t recv_time);
+    void publishMarketData(SHM_QUEUE_T& queue, Message::Type type, const MarketData& record);
+    void publishValue(SHM_QUEUE_T& queue, uint64_t websocket_id, const char* data, uint32_t len, uint64_t recv_time);
+    // publishes to a client data queue
+    void publishToClient(SHM_QUEUE_T& queue, Message* msg, uint64_t index, uint32_t size);
+    // every message goes unchanged to every client through server_queue_
+    bool broadcastsAll() const noexcept { return !options_.route_by_symbol && !splitter_; }
+    // zero copy reads: the websocket fills the payload of the reserved message, then publishes it
+    std::tuple<WsData*, uint64_t, uint32_t> reserveWsData(uint64_t id, uint32_t len);
+    void publishWsData(uint64_t index, uint32_t size);
+    void placeQueue(const char* name, SHM_QUEUE_T& queue, uint32_t size);
+    void clearClientSubscriptions(const ClientInfo& client);
+    void releaseClientSlot(const ClientInfo& client);
+    void retireClientDataQueue(std::unique_ptr<SHM_QUEUE_T> queue);
     void removeClosedSockets();
 
-    template<typename T>
-    std::tuple<Message*, uint64_t, uint32_t> reserveMessage(uint32_t data_size = 0) {
-        auto size = get_message_size<T>(data_size);
-        auto index = server_queue_.reserve(size);
-        auto msg = reinterpret_cast<Message*>(server_queue_[index]);
-        memset(msg, 0, size);
-        msg->pid = pid_;
-        return std::make_tuple(msg, index, size);
+    template<typename T = void>
+    MessageSlot<T> reserveMessage(Message::Type type, uint32_t data_size = 0) {
+        return reserveMessageSlot<T>(server_queue_, pid_, type, data_size);
     }
 
-    std::tuple<Message*, uint64_t, uint32_t> reserveMessage() {
-        uint32_t size = sizeof(Message);
-        auto index = server_queue_.reserve(size);
-        auto msg = reinterpret_cast<Message*>(server_queue_[index]);
-        memset(msg, 0, size);
-        msg->pid = pid_;
-        return std::make_tuple(msg, index, size);
+    template<typename T>
+    MessageSlot<T> reserveMessage(SHM_QUEUE_T& queue, Message::Type type, uint32_t data_size = 0) {
+        return reserveMessageSlot<T>(queue, pid_, type, data_size);
     }
 };
 
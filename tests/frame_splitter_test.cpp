@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <frame_splitter.h>
+#include <string>
+
+using namespace websocket_proxy;
+
+namespace {
+
+bool split(FrameSplitter& splitter, const std::string& frame, std::vector<FramePart>& parts) {
+    return splitter.split(frame.data(), static_cast<uint32_t>(frame.size()), parts);
+}
+
+std::string text(const FramePart& part) {
+    return std::string(part.data, part.len);
+}
+
+void testSplit() {
+    JsonArraySplitter splitter;
+    std::vector<FramePart> parts;
+    std::string frame = R"([{"T":"q","S":"AAPL","bp":1},{"T":"t","S":"MSFT","c":["@","I"]}, {"T":"b","S":"SPY"}])";
+    CHECK(split(splitter, frame, parts));
+    CHECK(parts.size() == 3);
+    if (parts.size() == 3) {
+        CHECK(text(parts[0]) == R"({"T":"q","S":"AAPL","bp":1})");
+        CHECK(text(parts[1]) == R"({"T":"t","S":"MSFT","c":["@","I"]})");
+        CHECK(text(parts[2]) == R"({"T":"b","S":"SPY"})");
+        CHECK(parts[0].symbol == "AAPL" && parts[1].symbol == "MSFT" && parts[2].symbol == "SPY");
+        // parts point into the frame
+        CHECK(parts[0].data > frame.data() && parts[2].data + parts[2].len < frame.data() + frame.size());
+    }
+
+    // parts is reused, not appended to
+    CHECK(split(splitter, R"([{"S":"A"},{"S":"B"}])", parts));
+    CHECK(parts.size() == 2);
+}
+
+// Braces, brackets and quotes inside strings don't end an object
+void testStrings() {
+    JsonArraySplitter splitter;
+    std::vector<FramePart> parts;
+    std::string frame = R"([{"S":"A","msg":"}]{[ \"quoted\" \\"},{"S":"B","nested":{"x":[1,{"y":2}]}}])";
+    CHECK(split(splitter, frame, parts));
+    CHECK(parts.size() == 2);
+    if (parts.size() == 2) {
+        CHECK(text(parts[0]) == R"({"S":"A","msg":"}]{[ \"quoted\" \\"})");
+        CHECK(parts[1].symbol == "B");
+    }
+}
+
+// Frames spanning many scan blocks
+void testLargeFrame() {
+    JsonArraySplitter splitter;
+    std::vector<FramePart> parts;
+    std::string frame = "[";
+    for (int i = 0; i < 100; ++i) {
+        if (i) {
+            frame += ",";
+        }
+        frame += R"({"T":"q","S":"S)" + std::to_string(i) + R"(","bp":150.1,"bs":1,"ap":150.2,"as":2,"c":["R"],"z":"C"})";
+    }
+    frame += "]";
+    CHECK(split(splitter, frame, parts));
+    CHECK(parts.size() == 100);
+    if (parts.size() == 100) {
+        CHECK(parts[0].symbol == "S0");
+        CHECK(parts[99].symbol == "S99");
+    }
+}
+
+void testForwardedAsIs() {
+    JsonArraySplitter splitter;
+    std::vector<FramePart> parts;
+    // a single object keeps its framing
+    CHECK(!split(splitter, R"([{"T":"q","S":"AAPL"}])", parts));
+    CHECK(!split(splitter, R"({"T":"q","S":"AAPL"})", parts));
+    CHECK(!split(splitter, R"([{"S":"A"},{"S":"B")", parts));
+    // truncated after a complete object, only the closing bracket is missing
+    CHECK(!split(splitter, R"([{"S":"A"},{"S":"B"})", parts));
+    CHECK(!split(splitter, R"([{"S":"A"},{"S":"B"},)", parts));
+    CHECK(!split(splitter, R"([{"S":"A"},{"S":"B","c":["]"]})", parts));
+    CHECK(split(splitter, "[{\"S\":\"A\"},{\"S\":\"B\"}]\r\n", parts));
+    CHECK(!split(splitter, "[]", parts));
+    CHECK(!split(splitter, "", parts));
+
+    // unless single objects are split too, e.g. to decode them
+    JsonArraySplitter single(true);
+    std::string frame = R"([{"T":"q","S":"AAPL"}])";
+    CHECK(split(single, frame, parts));
+    CHECK(parts.size() == 1 && parts[0].symbol == "AAPL");
+}
+
+}
+
+int main() {
+    testSplit();
+    testStrings();
+    testLargeFrame();
+    testForwardedAsIs();
+    return test::result();
+}
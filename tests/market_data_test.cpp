@@ -0,0 +1,147 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <websocket_proxy/market_data.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace websocket_proxy;
+
+namespace {
+
+constexpr uint64_t kTime = 1614009105335689322ULL;    // 2021-02-22T15:51:45.335689322Z
+
+void testTimestamp() {
+    uint64_t ns = 0;
+    CHECK(market_data::parseTimestamp("2021-02-22T15:51:45.335689322Z", ns) && ns == kTime);
+    CHECK(market_data::parseTimestamp("2021-02-22T10:51:45.335689322-05:00", ns) && ns == kTime);
+    CHECK(market_data::parseTimestamp("2021-02-22T15:51:45Z", ns) && ns == kTime / 1000000000ULL * 1000000000ULL);
+    CHECK(market_data::parseTimestamp("2021-02-22T15:51:44.208Z", ns) && ns == 1614009104208000000ULL);
+    CHECK(market_data::parseTimestamp("1970-01-01T00:00:00Z", ns) && ns == 0);
+    CHECK(market_data::parseTimestamp("2024-02-29T00:00:00Z", ns) && ns == 1709164800ULL * 1000000000ULL);
+    CHECK(!market_data::parseTimestamp("2021-13-22T15:51:45Z", ns));
+    CHECK(!market_data::parseTimestamp("2021-02-22", ns));
+    CHECK(!market_data::parseTimestamp("", ns));
+}
+
+// The values of a quote written as JSON come back out of the record
+void testQuoteRoundTrip() {
+    char json[256];
+    auto n = snprintf(json, sizeof(json),
+        R"({"T":"q","S":"AAPL","bx":"V","bp":%.2f,"bs":%d,"ax":"Q","ap":%.2f,"as":%d,"c":["R"],"z":"C","t":"2021-02-22T15:51:45.335689322Z"})",
+        150.1, 3, 150.25, 7);
+    MarketData out;
+    Message::Type type;
+    CHECK(market_data::decode(json, n, 9, 11, type, out));
+    CHECK(type == Message::Type::Quote);
+    auto& quote = out.quote;
+    CHECK(quote.id == 9);
+    CHECK(quote.recv_time == 11);
+    CHECK(std::string(quote.symbol) == "AAPL");
+    CHECK(quote.bid_price == 150.1);
+    CHECK(quote.bid_size == 3);
+    CHECK(quote.ask_price == 150.25);
+    CHECK(quote.ask_size == 7);
+    CHECK(quote.bid_exchange == 'V');
+    CHECK(quote.ask_exchange == 'Q');
+    CHECK(quote.tape == 'C');
+    CHECK(quote.timestamp == kTime);
+}
+
+void testTradeRoundTrip() {
+    std::string json = R"({"T":"t","S":"MSFT","i":52983525029461,"x":"V","p":126.55,"s":100,"c":["@","I"],"z":"C","t":"2021-02-22T15:51:45.335689322Z"})";
+    MarketData out;
+    Message::Type type;
+    CHECK(market_data::decode(json.data(), json.size(), 1, 2, type, out));
+    CHECK(type == Message::Type::Trade);
+    auto& trade = out.trade;
+    CHECK(std::string(trade.symbol) == "MSFT");
+    CHECK(trade.trade_id == 52983525029461ULL);
+    CHECK(trade.price == 126.55);
+    CHECK(trade.size == 100);
+    CHECK(trade.exchange == 'V');
+    CHECK(trade.tape == 'C');
+    CHECK(trade.timestamp == kTime);
+}
+
+void testBarRoundTrip() {
+    std::string json = R"({"T":"d","S":"SPY","o":388.985,"h":389.13,"l":388.975,"c":389.12,"v":49378,"t":"2021-02-22T15:51:45.335689322Z","n":461,"vw":389.062639})";
+    MarketData out;
+    Message::Type type;
+    CHECK(market_data::decode(json.data(), json.size(), 1, 2, type, out));
+    CHECK(type == Message::Type::Bar);
+    auto& bar = out.bar;
+    CHECK(std::string(bar.symbol) == "SPY");
+    CHECK(bar.kind == 'd');
+    CHECK(bar.open == 388.985);
+    CHECK(bar.high == 389.13);
+    CHECK(bar.low == 388.975);
+    CHECK(bar.close == 389.12);
+    CHECK(bar.volume == 49378);
+    CHECK(bar.vwap == 389.062639);
+    CHECK(bar.trade_count == 461);
+    CHECK(bar.timestamp == kTime);
+}
+
+void testRejected() {
+    MarketData out;
+    Message::Type type;
+    auto decode = [&](std::string json) { return market_data::decode(json.data(), json.size(), 1, 2, type, out); };
+    CHECK(!decode(R"({"T":"success","msg":"authenticated"})"));
+    CHECK(!decode(R"({"T":"subscription","trades":["AAPL"]})"));
+    // missing price
+    CHECK(!decode(R"({"T":"t","S":"AAPL","i":1,"x":"V","s":1,"t":"2021-02-22T15:51:45Z"})"));
+    // symbol too long for the record
+    CHECK(!decode(R"({"T":"t","S":"ABCDEFGHIJKLMNOPQRSTUVWXYZ","i":1,"p":1,"s":1,"t":"2021-02-22T15:51:45Z"})"));
+}
+
+// A batched frame decodes object by object, as the proxy publishes it
+void testFrame() {
+    std::string frame = R"([{"T":"q","S":"AAPL","bp":1,"bs":2,"ap":3,"as":4,"t":"2021-02-22T15:51:45Z"},)"
+                        R"({"T":"t","S":"MSFT","i":5,"p":6,"s":7,"t":"2021-02-22T15:51:45Z"},{"T":"error","code":400}])";
+    std::vector<Message::Type> types;
+    std::vector<std::string> symbols;
+    auto ok = json::forEachObject(frame.data(), frame.size(), [&](const char* obj, size_t n) {
+        MarketData out;
+        Message::Type type;
+        if (market_data::decode(obj, n, 1, 2, type, out)) {
+            types.push_back(type);
+            symbols.emplace_back(type == Message::Type::Quote ? out.quote.symbol : out.trade.symbol);
+        }
+    });
+    CHECK(ok);
+    CHECK(types.size() == 2 && types[0] == Message::Type::Quote && types[1] == Message::Type::Trade);
+    CHECK(symbols.size() == 2 && symbols[0] == "AAPL" && symbols[1] == "MSFT");
+}
+
+}
+
+int main() {
+    testTimestamp();
+    testQuoteRoundTrip();
+    testTradeRoundTrip();
+    testBarRoundTrip();
+    testRejected();
+    testFrame();
+    return test::result();
+}
@@ -0,0 +1,103 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <websocket_proxy/stats.h>
+#include <memory>
+#include <thread>
+
+using namespace websocket_proxy;
+
+namespace {
+
+// Updates the snapshot like WebsocketProxy::updateStatsSegment
+void publish(ProxyStats& stats, uint64_t i) {
+    auto seq = stats.seq.load(std::memory_order_relaxed);
+    stats.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stats.update_time = i;
+    stats.websocket_count = static_cast<uint32_t>(i % kMaxStatsWebsockets);
+    for (uint32_t k = 0; k < kMaxStatsWebsockets; ++k) {
+        stats.websockets[k].frames_read = i;
+    }
+    stats.clients[kMaxStatsClients - 1].messages_consumed = i;
+    stats.seq.store(seq + 2, std::memory_order_release);
+}
+
+void testRead() {
+    auto stats = std::make_unique<ProxyStats>();
+    auto out = std::make_unique<ProxyStats>();
+    stats->version = PROXY_STATS_VERSION;
+    publish(*stats, 5);
+    CHECK(ProxyStatsReader::readSnapshot(*stats, *out, 1));
+    CHECK(out->update_time == 5);
+    CHECK(out->websocket_count == 5);
+
+    // a proxy of another version
+    stats->version = PROXY_STATS_VERSION + 1;
+    CHECK(!ProxyStatsReader::readSnapshot(*stats, *out, 1));
+    stats->version = PROXY_STATS_VERSION;
+
+    // the proxy stopped in the middle of an update
+    stats->seq.fetch_add(1);
+    CHECK(!ProxyStatsReader::readSnapshot(*stats, *out, 10));
+}
+
+// A successful read is never a mix of two updates
+void testConcurrent() {
+    auto stats = std::make_unique<ProxyStats>();
+    stats->version = PROXY_STATS_VERSION;
+    std::atomic_bool done{ false };
+    std::thread writer([&stats, &done]() {
+        for (uint64_t i = 1; i <= 100000; ++i) {
+            publish(*stats, i);
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    auto out = std::make_unique<ProxyStats>();
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+    while (!done.load(std::memory_order_acquire)) {
+        if (!ProxyStatsReader::readSnapshot(*stats, *out, 100)) {
+            continue;
+        }
+        ++reads;
+        auto i = out->update_time;
+        bool consistent = out->websocket_count == i % kMaxStatsWebsockets && out->clients[kMaxStatsClients - 1].messages_consumed == i;
+        for (uint32_t k = 0; k < kMaxStatsWebsockets && consistent; ++k) {
+            consistent = out->websockets[k].frames_read == i;
+        }
+        torn += !consistent;
+    }
+    writer.join();
+    CHECK(torn == 0);
+    CHECK(ProxyStatsReader::readSnapshot(*stats, *out, 1));
+    CHECK(out->update_time == 100000);
+}
+
+}
+
+int main() {
+    testRead();
+    testConcurrent();
+    return test::result();
+}
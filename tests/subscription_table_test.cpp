@@ -0,0 +1,138 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <symbol_table.h>
+
+using namespace websocket_proxy;
+
+namespace {
+
+ClientSet routed(const SubscriptionTable::Entry& entry) {
+    ClientSet set;
+    entry.collectClients(set);
+    return set;
+}
+
+void testSymbolTable() {
+    SymbolTable symbols(3, 16);
+    auto aapl = symbols.intern("AAPL");
+    auto msft = symbols.intern("MSFT");
+    CHECK(aapl == 0);
+    CHECK(msft == 1);
+    CHECK(symbols.intern("AAPL") == aapl);
+    CHECK(symbols.find("MSFT") == msft);
+    CHECK(symbols.find("SPY") == SymbolTable::kInvalidId);
+    CHECK(symbols.name(aapl) == "AAPL");
+    // past the 16 byte arena
+    CHECK(symbols.intern("ABCDEFGHIJ") == SymbolTable::kInvalidId);
+    CHECK(symbols.intern("SPY") == 2);
+    // past the capacity
+    CHECK(symbols.intern("QQQ") == SymbolTable::kInvalidId);
+    CHECK(symbols.size() == 3);
+}
+
+void testClientSet() {
+    ClientSet set;
+    CHECK(set.empty());
+    CHECK(set.firstUnset() == 0);
+    for (uint32_t slot = 0; slot < 70; ++slot) {
+        set.set(slot);
+    }
+    CHECK(set.firstUnset() == 70);
+    set.reset(3);
+    CHECK(!set.test(3));
+    CHECK(set.firstUnset() == 3);
+    uint32_t count = 0;
+    set.forEach([&count](uint32_t) { ++count; });
+    CHECK(count == 69);
+    set.clear();
+    CHECK(set.empty());
+}
+
+// A released slot must not inherit the subscriptions of its previous client
+void testSlotReuse() {
+    SubscriptionTable table(64);
+    auto aapl = table.insert(1);
+    auto msft = table.insert(2);
+    CHECK(aapl && msft);
+    CHECK(table.insert(1) == aapl);
+    CHECK(table.find(3) == nullptr);
+
+    constexpr uint32_t kReused = 65;
+    aapl->addClient(kReused);
+    aapl->addClient(7);
+    msft->addClient(kReused);
+    msft->conflated[kReused >> 6].fetch_or(1ULL << (kReused & 63));
+    msft->setSnapshotPending(kReused);
+    CHECK(routed(*aapl).test(kReused));
+    CHECK(msft->isConflated(kReused));
+
+    table.removeClient(kReused);
+    CHECK(!routed(*aapl).test(kReused));
+    CHECK(routed(*aapl).test(7));
+    CHECK(!msft->hasClients());
+    CHECK(!msft->hasConflated());
+    CHECK(!msft->isSnapshotPending(kReused));
+
+    // the next client in the slot only gets what it subscribes
+    msft->addClient(kReused);
+    CHECK(routed(*msft).test(kReused));
+    CHECK(!routed(*aapl).test(kReused));
+    CHECK(!msft->isConflated(kReused));
+}
+
+void testSnapshotPending() {
+    SubscriptionTable table(64);
+    auto entry = table.insert(1);
+    entry->setSnapshotPending(3);
+    entry->addClient(3);
+    entry->addClient(4);
+    CHECK(entry->hasClients());
+    CHECK(!routed(*entry).test(3));
+    CHECK(routed(*entry).test(4));
+    entry->clearSnapshotPending(3);
+    CHECK(routed(*entry).test(3));
+}
+
+void testFull() {
+    // a quarter of the slots stays free for probing
+    SubscriptionTable table(16);
+    for (uint32_t id = 0; id < 12; ++id) {
+        CHECK(table.insert(id) != nullptr);
+    }
+    CHECK(table.insert(12) == nullptr);
+    CHECK(table.insert(5) != nullptr);
+    for (uint32_t id = 0; id < 12; ++id) {
+        CHECK(table.find(id) != nullptr);
+    }
+}
+
+}
+
+int main() {
+    testSymbolTable();
+    testClientSet();
+    testSlotReuse();
+    testSnapshotPending();
+    testFull();
+    return test::result();
+}
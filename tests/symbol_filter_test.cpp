@@ -0,0 +1,112 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <websocket_proxy/symbol_filter.h>
+#include <random>
+#include <set>
+
+using namespace websocket_proxy;
+
+namespace {
+
+void testInsertErase() {
+    SymbolFilter filter;
+    CHECK(!filter.contains("AAPL"));
+    CHECK(filter.insert("AAPL"));
+    CHECK(!filter.insert("AAPL"));
+    CHECK(filter.insert("MSFT"));
+    CHECK(!filter.insert(""));
+    CHECK(filter.size() == 2);
+    CHECK(filter.contains("AAPL"));
+    CHECK(!filter.contains("AAP"));
+    CHECK(!filter.contains("AAPLX"));
+    CHECK(filter.erase("AAPL"));
+    CHECK(!filter.erase("AAPL"));
+    CHECK(!filter.contains("AAPL"));
+    CHECK(filter.contains("MSFT"));
+    CHECK(filter.size() == 1);
+
+    SymbolFilter from_set(std::unordered_set<std::string>{ "SPY", "QQQ" });
+    CHECK(from_set.contains("SPY") && from_set.contains("QQQ"));
+}
+
+// Symbols too long to key let everything through while subscribed
+void testLongSymbols() {
+    std::string symbol(SymbolFilter::kMaxLen + 1, 'X');
+    SymbolFilter filter;
+    filter.insert("AAPL");
+    CHECK(!filter.contains("MSFT"));
+    CHECK(filter.insert(symbol));
+    CHECK(filter.contains("MSFT"));
+    CHECK(filter.erase(symbol));
+    CHECK(!filter.contains("MSFT"));
+    CHECK(!filter.erase(symbol));
+    CHECK(!filter.contains(std::string(SymbolFilter::kMaxLen, 'X')));
+    CHECK(filter.insert(std::string(SymbolFilter::kMaxLen, 'X')));
+    CHECK(filter.contains(std::string(SymbolFilter::kMaxLen, 'X')));
+}
+
+void testPasses() {
+    SymbolFilter filter;
+    filter.insert("AAPL");
+    auto passes = [&filter](std::string_view frame) { return filter.passes(frame.data(), frame.size()); };
+    CHECK(passes(R"([{"T":"q","S":"AAPL","bp":1}])"));
+    CHECK(!passes(R"([{"T":"q","S":"MSFT","bp":1}])"));
+    CHECK(passes(R"([{"T":"q","S":"MSFT"},{"T":"t","S":"AAPL"}])"));
+    // control messages have no symbol
+    CHECK(passes(R"([{"T":"success","msg":"authenticated"}])"));
+    filter.erase("AAPL");
+    CHECK(!passes(R"([{"T":"q","S":"AAPL","bp":1}])"));
+}
+
+// Erasing keeps every other key reachable through the probe sequences, checked against std::set
+void testRandomized() {
+    std::mt19937 rng(7);
+    SymbolFilter filter;
+    std::set<std::string> expected;
+    for (int i = 0; i < 100000; ++i) {
+        auto symbol = "S" + std::to_string(rng() % 300);
+        if (rng() % 3) {
+            CHECK(filter.insert(symbol) == expected.insert(symbol).second);
+        }
+        else {
+            CHECK(filter.erase(symbol) == (expected.erase(symbol) == 1));
+        }
+        if (i % 5000 == 0) {
+            for (int k = 0; k < 300; ++k) {
+                auto probe = "S" + std::to_string(k);
+                CHECK(filter.contains(probe) == (expected.count(probe) == 1));
+            }
+        }
+    }
+    CHECK(filter.size() == expected.size());
+}
+
+}
+
+int main() {
+    testInsertErase();
+    testLongSymbols();
+    testPasses();
+    testRandomized();
+    return test::result();
+}
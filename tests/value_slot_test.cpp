@@ -0,0 +1,101 @@
+// The MIT License (MIT)
+// Copyright (c) 2024-2025 Kun Zhao
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "test.h"
+#include <symbol_table.h>
+#include <string>
+#include <thread>
+
+using namespace websocket_proxy;
+
+namespace {
+
+void testStoreLoad() {
+    ValueSlot slot;
+    char out[ValueSlot::kMaxLen];
+    uint64_t recv_time = 0;
+    CHECK(slot.load(out, recv_time) == 0);
+
+    std::string quote = R"({"T":"q","S":"AAPL"})";
+    CHECK(slot.store(quote.data(), static_cast<uint32_t>(quote.size()), false, 42));
+    auto n = slot.load(out, recv_time);
+    CHECK(std::string(out, n) == quote);
+    CHECK(recv_time == 42);
+
+    // an object split out of a frame keeps the array framing
+    CHECK(slot.store(quote.data(), static_cast<uint32_t>(quote.size()), true, 43));
+    n = slot.load(out, recv_time);
+    CHECK(std::string(out, n) == "[" + quote + "]");
+    CHECK(recv_time == 43);
+
+    // too large, the previous value stays
+    std::string large(ValueSlot::kMaxLen - 1, 'x');
+    CHECK(!slot.store(large.data(), static_cast<uint32_t>(large.size()), true, 44));
+    CHECK(slot.load(out, recv_time) == quote.size() + 2);
+    CHECK(slot.store(large.data(), static_cast<uint32_t>(large.size()), false, 45));
+    CHECK(slot.load(out, recv_time) == large.size());
+
+    // cleared once no longer updated
+    slot.clear();
+    CHECK(slot.load(out, recv_time) == 0);
+    CHECK(slot.store(quote.data(), static_cast<uint32_t>(quote.size()), false, 46));
+    CHECK(slot.load(out, recv_time) == quote.size());
+}
+
+// The reader never sees a value mixed from two stores
+void testConcurrent() {
+    ValueSlot slot;
+    std::atomic_bool done{ false };
+    std::thread writer([&slot, &done]() {
+        char value[ValueSlot::kMaxLen];
+        for (uint32_t i = 1; i <= 200000; ++i) {
+            auto len = 1 + i % ValueSlot::kMaxLen;
+            memset(value, 'a' + i % 26, len);
+            slot.store(value, len, false, i);
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    char out[ValueSlot::kMaxLen];
+    uint64_t recv_time = 0;
+    uint32_t torn = 0;
+    while (!done.load(std::memory_order_acquire)) {
+        auto n = slot.load(out, recv_time);
+        if (!n) {
+            continue;
+        }
+        bool consistent = n == 1 + recv_time % ValueSlot::kMaxLen;
+        for (uint32_t k = 0; k < n && consistent; ++k) {
+            consistent = out[k] == static_cast<char>('a' + recv_time % 26);
+        }
+        torn += !consistent;
+    }
+    writer.join();
+    CHECK(torn == 0);
+}
+
+}
+
+int main() {
+    testStoreLoad();
+    testConcurrent();
+    return test::result();
+}